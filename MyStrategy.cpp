@@ -1,8 +1,32 @@
 #include "MyStrategy.hpp"
 #include <iostream>
 #include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <bitset>
+#include <map>
+#include <algorithm>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+#ifdef BACKGROUND_PRECOMPUTE
+#include <thread>
+#endif
+#ifdef ORACLE_VALIDATION
+#include <cstdlib>
+#include <atomic>
+#endif
+#ifdef SLOW_TICK_WATCHDOG
+#include <chrono>
+#include <cstdio>
+#endif
+#ifdef GAME_TELEMETRY
+#include <chrono>
+#include <cstdio>
+#endif
 
 #define MAP_SIZE 80
+#define NUM_ENTITY_TYPES 10
 
 using namespace std;
 
@@ -19,6 +43,8 @@ const int allyRunAwayRange = 3;
 const int enemyRunAwayRange = 10;
 const int troopsAttackBuilderDistance = 5;
 const int troopsAttackBaseDistance = 5;
+// Fewer ranged units and turrets than this look for their targets one by one, it's cheaper than the focus fire allocator
+const int focusFireMinAttackers = 20;
 // Don't run away from specific enemies when the distance is equal or less
 const int ranged_dontRunAwayFromRanged = 5;
 const int ranged_dontRunAwayFromMelee = 3;
@@ -29,16 +55,68 @@ const float enemyMeleeRunAwayMultiplier = 0.5f;
 const float enemyRangedRunAwayMultiplier = 1.5f;
 const float allyMeleeRunAwayMultiplier = 0.33f;
 const float allyRangedRunAwayMultiplier = 1.0f;
+// Paths
+const int pathMaxAge = 10;
+const int pathRepairRange = 16;
+// Squads
+const int maxSquads = 16;
+const int squadMinSize = 3;
+const int squadLinkRange = 3;
+const int squadEngageRange = 12;
+const int squadMaxSpread = 4;
+// Number of houses planned on the first tick
+const int openingLayoutHouses = 24;
+// Resources
+const int resourceRebuildRemovals = 256;
+// Territory, the cells this far from our nearest building are in the base, the range starts at the building and not at the map corner like baseSize
+const int territoryFar = MAP_SIZE * MAP_SIZE;
+const int baseTerritoryRange = 5;
+// Sectors, every coarser size is a multiple of the finest one
+#define NUM_SECTOR_LEVELS 3
+#define FINEST_SECTOR_SIZE 8
+const int sectorSizes[NUM_SECTOR_LEVELS] = { FINEST_SECTOR_SIZE, 16, 40 };
 // Etc
 const float troopsBuildersRatio = 0.4f;
+// Sends only new and changed entity actions, the game keeps the last action of an entity that didn't get a new one
+const bool sendOnlyChangedActions = false;
+#ifdef SLOW_TICK_WATCHDOG
+// Build with -DSLOW_TICK_WATCHDOG=<ms>, the ticks that take longer are saved to slow_tick_<tick>.bin
+const double slowTickThreshold = SLOW_TICK_WATCHDOG;
+const int slowTickMaxDumps = 16;
+#endif
+const int slowTickFileVersion = 2;
+#ifdef GAME_TELEMETRY
+// Build with -DGAME_TELEMETRY, a row of the economy and search counters is appended to the file every tick
+const char *const telemetryFileName = "telemetry.csv";
+const int telemetryFlushTicks = 100;
+#endif
+
+// The per-tick state is made once for every tick
+int currentTick;
+
+#ifdef GAME_TELEMETRY
+// Counters of the current tick for the telemetry file
+struct telemetry_t
+{
+    int failedMoves;
+    int replans;
+    int blockedBuilders;
+    int idleBuilders;
+};
+
+telemetry_t telemetry;
+// The worker thread searches too, only the game thread's searches are counted
+thread_local long long searchCellsExpanded;
+#endif
 
 vector<Vec2Int> knownEnemies;
 vector<Vec2Int> knownEnemySpawns;
+unordered_map<int, EntityAction> lastActions;
 
 int unitPositionsAtLastTick[MAP_SIZE][MAP_SIZE];
 int unitPositionsAtCurrentTick[MAP_SIZE][MAP_SIZE];
 
-enum tile_t
+enum tile_t : uint8_t
 {
     TILE_EMPTY,
     TILE_BLOCKED,
@@ -55,6 +133,70 @@ enum path_t
     PATH_START = 0
 };
 
+enum gridLayout_t
+{
+    GRID_ROW_MAJOR,
+    GRID_TILED
+};
+
+enum pathMode_t
+{
+    PATH_MODE_FLOOD,
+    PATH_MODE_JUMP
+};
+
+// The flood passes the destroyable tiles, the jump search doesn't
+enum reachProfile_t
+{
+    REACH_MOVE,
+    REACH_OPEN,
+    NUM_REACH_PROFILES
+};
+
+// Map sized grid, the tiled layout keeps the cells of 8x8 blocks next to each other in memory
+template <typename T, gridLayout_t layout = GRID_ROW_MAJOR>
+struct grid_t
+{
+    static const int tileSize = 8;
+    static const int tilesPerRow = MAP_SIZE / tileSize;
+
+    T cells[MAP_SIZE * MAP_SIZE];
+
+    static int Index(int x, int y)
+    {
+        if (layout == GRID_TILED)
+            return ((x / tileSize) * tilesPerRow + y / tileSize) * tileSize * tileSize + (x % tileSize) * tileSize + y % tileSize;
+
+        return x * MAP_SIZE + y;
+    }
+
+    T &operator()(int x, int y) { return cells[Index(x, y)]; }
+    const T &operator()(int x, int y) const { return cells[Index(x, y)]; }
+
+    // Visits the cells in the memory order
+    template <typename Function>
+    void ForEach(Function function)
+    {
+        if (layout == GRID_TILED)
+        {
+            for (int tileX = 0; tileX < MAP_SIZE; tileX += tileSize)
+                for (int tileY = 0; tileY < MAP_SIZE; tileY += tileSize)
+                    for (int x = tileX; x < tileX + tileSize; x++)
+                        for (int y = tileY; y < tileY + tileSize; y++)
+                            function(x, y, (*this)(x, y));
+        }
+        else
+        {
+            for (int x = 0; x < MAP_SIZE; x++)
+                for (int y = 0; y < MAP_SIZE; y++)
+                    function(x, y, cells[x * MAP_SIZE + y]);
+        }
+    }
+};
+
+// Path labels, 16 bits cover the paths on the map and the whole grid fits into L1
+typedef grid_t<int16_t> pathGrid_t;
+
 enum buildingAlign_t
 {
     ALIGN_IN_CORNER,
@@ -68,9 +210,274 @@ enum player_t
     PLAYER_ENEMY
 };
 
+struct enemyCandidates_t
+{
+    int nearest = -1;
+    int nearestSquaredDistance = numeric_limits<int>::max();
+    int firstInRange = -1;
+};
+
+struct enemyQuery_t
+{
+    bool done = false;
+    enemyCandidates_t types[NUM_ENTITY_TYPES];
+};
+
+enum distance_t
+{
+    DISTANCE_SQUARED,
+    DISTANCE_MANHATTAN
+};
+
+// Structure of arrays of positions for the batch distance kernels
+struct positionList_t
+{
+    vector<int> x;
+    vector<int> y;
+    vector<int> index;
+
+    void Clear() { x.clear(); y.clear(); index.clear(); }
+    void Add(const Vec2Int &position, int entityIndex = -1) { x.push_back(position.x); y.push_back(position.y); index.push_back(entityIndex); }
+    int Size() const { return (int)x.size(); }
+};
+
+// Numbers of the entities in a sector by the side and the type
+struct sector_t
+{
+    unsigned int types[2] = {};
+    int counts[2][NUM_ENTITY_TYPES] = {};
+};
+
+struct sectorEntity_t
+{
+    int x;
+    int y;
+    int owner;
+    int type;
+    int index;
+};
+
+const unsigned int allEntityTypes = (1u << NUM_ENTITY_TYPES) - 1;
+const unsigned int troopTypes = (1u << MELEE_UNIT) | (1u << RANGED_UNIT);
+
+// List positions by the cells, -1 on the other cells. Only the cells of the list are written, Reset clears them again
+struct positionIndex_t
+{
+    int cells[MAP_SIZE][MAP_SIZE];
+
+    positionIndex_t()
+    {
+        for (int i = 0; i < MAP_SIZE; i++)
+            for (int j = 0; j < MAP_SIZE; j++)
+                cells[i][j] = -1;
+    }
+
+    void Set(const positionList_t &positions) { for (int n = 0; n < positions.Size(); n++) cells[positions.x[n]][positions.y[n]] = n; }
+    void Reset(const positionList_t &positions) { for (int n = 0; n < positions.Size(); n++) cells[positions.x[n]][positions.y[n]] = -1; }
+    int operator()(int x, int y) const { return cells[x][y]; }
+};
+
+// Stored path of a unit, the cells go from the unit position to the target
+struct unitPath_t
+{
+    Vec2Int target;
+    vector<Vec2Int> cells;
+    int tick;
+};
+
+enum intent_t
+{
+    INTENT_NONE,
+    INTENT_GATHER
+};
+
+// Decision of a unit that is kept while nothing it depends on has changed
+struct unitIntent_t
+{
+    intent_t intent = INTENT_NONE;
+    int targetId;
+    Vec2Int target;
+    Vec2Int position;
+    int tick;
+};
+
+// Column span of a footprint stencil relative to the entity position
+struct stencilSpan_t
+{
+    int x;
+    int minY;
+    int maxY;
+};
+
+// Troops that are close to each other, they share one target and one movement field
+struct squad_t
+{
+    vector<int> members;
+    int anchor;
+    int worthToAttack;
+    bool fieldReady;
+    bool hasTarget;
+    Vec2Int target;
+    int averageDistance;
+    enemyQuery_t enemies;
+    pathGrid_t field;
+};
+
+// Building reserved by the build planner for the current tick
+struct buildPlan_t
+{
+    int builder = -1;
+    Vec2Int position;
+    vector<Vec2Int> positionsForBuilding;
+};
+
+// Union-find node of a resource cell, the counters are valid only for the root
+struct resourceCluster_t
+{
+    int parent;
+    int cells;
+    int frontier;
+};
+
 tile_t worldMap[MAP_SIZE][MAP_SIZE];
 tile_t buildMap[MAP_SIZE][MAP_SIZE];
 
+map<pair<int, int>, vector<stencilSpan_t>> stencils;
+bitset<MAP_SIZE> visibilityMask[MAP_SIZE];
+bitset<MAP_SIZE> enemyPositions[MAP_SIZE];
+
+// Positions of the current tick
+positionList_t allyPositions[NUM_ENTITY_TYPES];
+positionList_t allyTroops;
+positionList_t enemies;
+positionList_t damagedBuildings;
+
+// Sector pyramid of the current tick, the entities are sorted by the finest sectors
+vector<sector_t> sectorLevels[NUM_SECTOR_LEVELS];
+int sectorStarts[(MAP_SIZE / FINEST_SECTOR_SIZE) * (MAP_SIZE / FINEST_SECTOR_SIZE) + 1];
+vector<sectorEntity_t> sectorEntities;
+
+pathGrid_t moveMap;
+bitset<MAP_SIZE> turretMask[MAP_SIZE];
+unordered_map<int, unitPath_t> unitPaths;
+unordered_map<int, unitIntent_t> unitIntents;
+
+// Jump point search tables over the move map, the destroyable tiles are walls there.
+// xJumps[dir][y][x] is the distance along x to the next jump point when positive, or minus the free cells up to a wall
+bitset<MAP_SIZE> jumpBlocked[MAP_SIZE];
+int8_t xJumps[2][MAP_SIZE][MAP_SIZE];
+bool jumpTablesValid;
+
+// Connected components of the passable tiles by the blocking profile, 0 on the blocked tiles
+int16_t reachLabels[NUM_REACH_PROFILES][MAP_SIZE][MAP_SIZE];
+
+buildPlan_t buildPlans[NUM_ENTITY_TYPES];
+vector<Vec2Int> openingLayout;
+
+// Map of the terrain and the buildings without the units
+tile_t terrainMap[MAP_SIZE][MAP_SIZE];
+
+#ifdef BACKGROUND_PRECOMPUTE
+// Speculative work for the next tick, the worker fills the back buffer while the game is simulated
+struct precompute_t
+{
+    PlayerView view;
+    pathGrid_t source;
+    tile_t buildMap[MAP_SIZE][MAP_SIZE];
+    vector<Vec2Int> spawns;
+    vector<pathGrid_t> fields;
+    vector<int> horizons;
+    bool houseFound;
+    Vec2Int house;
+};
+
+precompute_t precomputeBuffers[2];
+precompute_t *precomputed = nullptr;
+
+// The runner can exit while the worker is still busy
+struct precomputeWorker_t : thread
+{
+    ~precomputeWorker_t() { if (joinable()) join(); }
+    using thread::operator=;
+} precomputeWorker;
+#endif
+
+// Resource index of the game, removed cells stay in their clusters until the index is rebuilt
+resourceCluster_t resourceClusters[MAP_SIZE * MAP_SIZE];
+bitset<MAP_SIZE> resourceNodeMask[MAP_SIZE];
+bitset<MAP_SIZE> resourceMask[MAP_SIZE];
+bitset<MAP_SIZE> resourceFrontierMask[MAP_SIZE];
+int resourceIds[MAP_SIZE][MAP_SIZE];
+int numOfResourceCells;
+int numOfRemovedResources;
+int numOfVisibleFrontier;
+
+// Cells we have seen in the fog of war, the frontier is the unexplored cells next to them
+bitset<MAP_SIZE> exploredMask[MAP_SIZE];
+bitset<MAP_SIZE> frontierMask[MAP_SIZE];
+int numOfExploredCells;
+pathGrid_t frontierField;
+int frontierFieldTick = -1;
+
+// Manhattan distance to the nearest enemy troop or turret
+int safetyMap[MAP_SIZE][MAP_SIZE];
+
+squad_t squads[maxSquads];
+int numOfSquads;
+int squadMap[MAP_SIZE][MAP_SIZE];
+
+// Targets of the ranged units and turrets by their ids, -1 when no enemy is in range.
+// The slot is the list of the enemies in range of the attacker, positions in the enemy list
+struct focusTarget_t
+{
+    int target;
+    int slot;
+};
+
+unordered_map<int, focusTarget_t> focusTargets;
+vector<vector<int>> focusInRange;
+
+// Building to repair and the cell to repair it from by the builder ids
+struct repairAssignment_t
+{
+    int targetId;
+    Vec2Int slot;
+};
+
+unordered_map<int, repairAssignment_t> repairAssignments;
+
+// Unit to produce and the tile to spawn it on by the production building ids
+struct production_t
+{
+    EntityType type;
+    Vec2Int spawn;
+};
+
+// Perimeter of the production buildings, the tick they were seen last at
+struct spawnTiles_t
+{
+    vector<Vec2Int> tiles;
+    int tick;
+};
+
+unordered_map<int, production_t> productionPlans;
+unordered_map<int, spawnTiles_t> spawnTiles;
+// Walking distance to the nearest mineable resource
+int resourceField[MAP_SIZE][MAP_SIZE];
+// Manhattan distance to the nearest enemy, to the last known ones in the fog of war
+int enemyField[MAP_SIZE][MAP_SIZE];
+
+// Walking distance from our buildings, only the cells around the changes of the last tick are updated
+int territoryField[MAP_SIZE][MAP_SIZE];
+// Direction to the cell the distance came from, -1 on the buildings and the unreached cells
+int8_t territoryParents[MAP_SIZE][MAP_SIZE];
+// Buildings and resources the field is made for, the enemy buildings don't block so the enemies in them are found
+bitset<MAP_SIZE> territorySources[MAP_SIZE];
+bitset<MAP_SIZE> territoryBlocked[MAP_SIZE];
+bool territoryValid;
+// Territory distance of the nearest enemy of the current tick
+int nearestEnemyTerritory;
+
 /*
 ===================
 Distance
@@ -78,149 +485,131 @@ Distance
 */
 float Distance(const Vec2Int &vec1, const Vec2Int &vec2)
 {
-    return sqrtf(powf((float)(vec1.x - vec2.x), 2) + powf((float)(vec1.y - vec2.y), 2));
+    return sqrtf((float)((vec1.x - vec2.x) * (vec1.x - vec2.x) + (vec1.y - vec2.y) * (vec1.y - vec2.y)));
 }
 
 /*
 ===================
-IsAtRange
+SquaredRange
+
+Squared distances of integer positions compare exactly like the Distance results against an integer range
 ===================
 */
-bool IsAtRange(const PlayerView &playerView, const Entity &entity, const Vec2Int &target, const int range)
+int SquaredRange(int range)
 {
-    int entitySize = playerView.entityProperties.at(entity.entityType).size;
-
-    for (int i = 0; i < entitySize; i++)
-    {
-        for (int j = 0; j < entitySize; j++)
-        {
-            for (int x = 0; x <= range; x++)
-                for (int y = 0; y <= range - x; y++)
-                    if (entity.position.x + i + x == target.x && entity.position.y + j + y == target.y)
-                        return true;
-
-            for (int x = -range; x <= 0; x++)
-                for (int y = 0; y <= range + x; y++)
-                    if (entity.position.x + i + x == target.x && entity.position.y + j + y == target.y)
-                        return true;
+    if (range < 0) return -1;
+    if (range >= 46340) return numeric_limits<int>::max();
 
-            for (int x = 0; x <= range; x++)
-                for (int y = 0; y >= -range + x; y--)
-                    if (entity.position.x + i + x == target.x && entity.position.y + j + y == target.y)
-                        return true;
-
-            for (int x = -range; x <= 0; x++)
-                for (int y = 0; y >= -range - x; y--)
-                    if (entity.position.x + i + x == target.x && entity.position.y + j + y == target.y)
-                        return true;
-        }
-    }
-
-    return false;
+    return range * range;
 }
 
+#ifdef ORACLE_VALIDATION
 /*
-===================
-GetNearestPosition
-===================
-*/
-bool GetNearestPosition(const Vec2Int &from, const vector<Vec2Int> &positions, Vec2Int &nearestPosition)
-{
-    bool found = false;
-    float nearestDistance = numeric_limits<float>::max();
-
-    for (const auto &position : positions)
-    {
-        float distance = Distance(from, position);
+===================================================================================================
+    ORACLE VALIDATION
 
-        if (distance < nearestDistance)
-        {
-            nearestDistance = distance;
-            nearestPosition.x = position.x;
-            nearestPosition.y = position.y;
-            found = true;
-        }
-    }
-
-    return found;
-}
+    Build with -DORACLE_VALIDATION to run the plain reference implementations next to the
+    optimized kernels on the same inputs, the first mismatch aborts the process
+===================================================================================================
+*/
+// The background precompute worker runs the checks too
+atomic<long long> numOfOracleChecks(0);
 
 /*
 ===================
-GetSpawnPoints
+OracleCheck
 ===================
 */
-void GetSpawnPoints(const PlayerView &playerView, const Entity &spawnObject, const tile_t (&map)[MAP_SIZE][MAP_SIZE], vector<Vec2Int> &spawns)
+void OracleCheck(const PlayerView &playerView, bool match, const char *kernel)
 {
-    spawns.clear();
-    int x = spawnObject.position.x;
-    int y = spawnObject.position.y;
-    int size = playerView.entityProperties.at(spawnObject.entityType).size;
+    numOfOracleChecks.fetch_add(1, memory_order_relaxed);
 
-    for (int k = 0; x > 0 && k < size; k++)                  if (map[x - 1][y + k] == TILE_EMPTY)      spawns.push_back(Vec2Int(x - 1, y + k));
-    for (int k = 0; x + size < MAP_SIZE && k < size; k++)    if (map[x + size][y + k] == TILE_EMPTY)   spawns.push_back(Vec2Int(x + size, y + k));
-    for (int k = 0; y > 0 && k < size; k++)                  if (map[x + k][y - 1] == TILE_EMPTY)      spawns.push_back(Vec2Int(x + k, y - 1));
-    for (int k = 0; y + size < MAP_SIZE && k < size; k++)    if (map[x + k][y + size] == TILE_EMPTY)   spawns.push_back(Vec2Int(x + k, y + size));
+    if (match)
+        return;
+
+    cerr << "Oracle mismatch in " << kernel << " at tick " << playerView.currentTick << endl;
+    abort();
 }
 
 /*
 ===================
-GetNearestSpawnPoint
+OracleCheck
+
+For the kernels that don't see the player view
 ===================
 */
-bool GetNearestSpawnPoint(const PlayerView &playerView, const Entity &spawnObject, const Vec2Int &targetPosition, Vec2Int &spawn)
+void OracleCheck(bool match, const char *kernel)
 {
-    vector<Vec2Int> spawns;
-    GetSpawnPoints(playerView, spawnObject, worldMap, spawns);
+    numOfOracleChecks.fetch_add(1, memory_order_relaxed);
 
-    if (GetNearestPosition(targetPosition, spawns, spawn))
-        return true;
+    if (match)
+        return;
 
-    return false;
+    cerr << "Oracle mismatch in " << kernel << endl;
+    abort();
 }
 
 /*
 ===================
-GetNumberOfTroops
+SamePositions
 ===================
 */
-int GetNumberOfTroops(const PlayerView &playerView, const Entity &fromEntity, const player_t player, int range = numeric_limits<int>::max())
+bool SamePositions(const vector<Vec2Int> &positions1, const vector<Vec2Int> &positions2)
 {
-    int troops = 0;
+    if (positions1.size() != positions2.size())
+        return false;
 
-    for (const auto &entity : playerView.entities)
-        if (entity.playerId && (*entity.playerId == playerView.myId && player == player_t::PLAYER_ALLY || *entity.playerId != playerView.myId && player == player_t::PLAYER_ENEMY) && (entity.entityType == MELEE_UNIT || entity.entityType == RANGED_UNIT))
-            if (Distance(fromEntity.position, entity.position) <= range)
-                troops++;
+    for (size_t i = 0; i < positions1.size(); i++)
+        if (positions1[i].x != positions2[i].x || positions1[i].y != positions2[i].y)
+            return false;
 
-    return troops;
+    return true;
 }
 
 /*
 ===================
-IsEntityCloserToPosition
+ReferenceIsAtRange
 ===================
 */
-bool IsEntityCloserToPosition(const PlayerView &playerView, const Entity &entity, const Vec2Int &position, int maxClosest = 1)
+bool ReferenceIsAtRange(const PlayerView &playerView, const Entity &entity, const Vec2Int &target, const int range)
 {
-    for (const auto &other : playerView.entities)
+    int entitySize = playerView.entityProperties.at(entity.entityType).size;
+
+    for (int i = 0; i < entitySize; i++)
     {
-        if (!other.playerId || *other.playerId != playerView.myId || other.entityType != entity.entityType || other.id == entity.id)
-            continue;
+        for (int j = 0; j < entitySize; j++)
+        {
+            for (int x = 0; x <= range; x++)
+                for (int y = 0; y <= range - x; y++)
+                    if (entity.position.x + i + x == target.x && entity.position.y + j + y == target.y)
+                        return true;
 
-        if (Distance(entity.position, position) > Distance(other.position, position) && !(--maxClosest))
-            return false;
+            for (int x = -range; x <= 0; x++)
+                for (int y = 0; y <= range + x; y++)
+                    if (entity.position.x + i + x == target.x && entity.position.y + j + y == target.y)
+                        return true;
+
+            for (int x = 0; x <= range; x++)
+                for (int y = 0; y >= -range + x; y--)
+                    if (entity.position.x + i + x == target.x && entity.position.y + j + y == target.y)
+                        return true;
+
+            for (int x = -range; x <= 0; x++)
+                for (int y = 0; y >= -range - x; y--)
+                    if (entity.position.x + i + x == target.x && entity.position.y + j + y == target.y)
+                        return true;
+        }
     }
 
-    return true;
+    return false;
 }
 
 /*
 ===================
-MakeMap
+ReferenceMakeMap
 ===================
 */
-void MakeMap(const PlayerView &playerView, tile_t (&map)[MAP_SIZE][MAP_SIZE], bool forBuilding = false)
+void ReferenceMakeMap(const PlayerView &playerView, tile_t (&map)[MAP_SIZE][MAP_SIZE], bool forBuilding, bool withUnits)
 {
     // Removes old data from the map
     if (playerView.fogOfWar)
@@ -276,6 +665,9 @@ void MakeMap(const PlayerView &playerView, tile_t (&map)[MAP_SIZE][MAP_SIZE], bo
     {
         const EntityProperties &properties = playerView.entityProperties.at(entity.entityType);
 
+        if (!withUnits && properties.canMove)
+            continue;
+
         // Adds an indent to our buildings for building
         if (forBuilding && (entity.entityType == BUILDER_BASE || entity.entityType == MELEE_BASE || entity.entityType == RANGED_BASE || entity.entityType == HOUSE || entity.entityType == TURRET))
         {
@@ -324,10 +716,10 @@ void MakeMap(const PlayerView &playerView, tile_t (&map)[MAP_SIZE][MAP_SIZE], bo
 
 /*
 ===================
-SearchPath
+ReferenceSearchPath
 ===================
 */
-bool SearchPath(const PlayerView &playerView, int (&map)[MAP_SIZE][MAP_SIZE], vector<Vec2Int> &targetPositions, int range = numeric_limits<int>::max())
+bool ReferenceSearchPath(int (&map)[MAP_SIZE][MAP_SIZE], vector<Vec2Int> &targetPositions, int range, int maxPath)
 {
     int path = 0;
     targetPositions.clear();
@@ -337,7 +729,7 @@ bool SearchPath(const PlayerView &playerView, int (&map)[MAP_SIZE][MAP_SIZE], ve
         bool stopSearch = true;
         bool found = false;
 
-        if (path > range) return !targetPositions.empty();
+        if (path > range || path > maxPath) return !targetPositions.empty();
 
         for (int i = 0; i < MAP_SIZE; i++)
         {
@@ -387,455 +779,4203 @@ bool SearchPath(const PlayerView &playerView, int (&map)[MAP_SIZE][MAP_SIZE], ve
 
 /*
 ===================
-SearchBuildingForRepair
+ReferenceSearchPlaceForBuilding
+
+Checks every place of the map and takes the first one in the order of the search
 ===================
 */
-bool SearchBuildingForRepair(const PlayerView &playerView, const Entity &builder, int &targetId, const Entity *&targetEntity, vector<Vec2Int> &positionsForBuilding, int range, const vector<EntityType> &preferedTypes = vector<EntityType>())
+bool ReferenceSearchPlaceForBuilding(const PlayerView &playerView, const Entity *builder, Vec2Int &position, vector<Vec2Int> &positionsForBuilding, EntityType type, int fromBase, buildingAlign_t align, const tile_t (&map)[MAP_SIZE][MAP_SIZE])
 {
-    float minDistance = numeric_limits<float>::max();
-    targetEntity = nullptr;
+    int size = playerView.entityProperties.at(type).size;
+    bool found = false;
+    long long bestRank = numeric_limits<long long>::max();
     positionsForBuilding.clear();
 
-    for (const auto &entity : playerView.entities)
-    {
-        if (!entity.playerId || *entity.playerId != playerView.myId)
-            continue;
+    if (align == ALIGN_AROUND_BUILDER && !builder)
+        return false;
 
-        if (!preferedTypes.empty())
+    // The builder can stand on the place it's going to build
+    auto isEmpty = [&](int x, int y) { return map[x][y] == TILE_EMPTY || (builder && builder->position.x == x && builder->position.y == y); };
+
+    for (int x = 0; x < MAP_SIZE - size; x++)
+    {
+        for (int y = 0; y < MAP_SIZE - size; y++)
         {
-            bool exclude = true;
+            long long rank;
+            bool canBuild = true;
 
-            for (const auto &preferedType : preferedTypes)
-                if (entity.entityType == preferedType)
-                    exclude = false;
+            if (align == ALIGN_IN_CORNER)
+            {
+                if (x + y < fromBase || x + y >= MAP_SIZE) continue;
+                rank = (long long)(x + y) * MAP_SIZE + x;
+            }
+            else if (align == ALIGN_IN_CORNER_CENTER)
+            {
+                // Only the even diagonals are visited, an odd one repeats the previous diagonal
+                int n = x + y;
+                int center = n / 2;
 
-            if (exclude) continue;
-        }
+                if (n % 2 || n + 1 < fromBase) continue;
+                if (n < fromBase) n = fromBase;
+                if (n >= MAP_SIZE) continue;
 
-        if (entity.entityType == HOUSE || entity.entityType == BUILDER_BASE || entity.entityType == MELEE_BASE || entity.entityType == RANGED_BASE || entity.entityType == TURRET)
-        {
-            if (entity.health < playerView.entityProperties.at(entity.entityType).maxHealth)
+                rank = ((long long)n * MAP_SIZE + abs(x - center)) * 2 + (x < center);
+            }
+            else
             {
-                float entityDistance = Distance(entity.position, builder.position);
+                int n = max(abs(x - builder->position.x), abs(y - builder->position.y));
+                rank = ((long long)n * MAP_SIZE + x) * MAP_SIZE + y;
+            }
 
-                if (entityDistance < minDistance && entityDistance < range)
-                {
-                    minDistance = entityDistance;
-                    targetId = entity.id;
-                    targetEntity = &entity;
-                }
+            if (rank >= bestRank) continue;
+
+            for (int i = x; i < x + size && canBuild; i++)
+                for (int j = y; j < y + size && canBuild; j++)
+                    canBuild = isEmpty(i, j);
+
+            if (canBuild)
+            {
+                bestRank = rank;
+                position = Vec2Int(x, y);
+                found = true;
             }
         }
     }
 
-    if (targetEntity)
+    if (found)
     {
-        worldMap[builder.position.x][builder.position.y] = TILE_EMPTY;
-        GetSpawnPoints(playerView, *targetEntity, worldMap, positionsForBuilding);
-        worldMap[builder.position.x][builder.position.y] = TILE_BLOCKED;
+        int x = position.x;
+        int y = position.y;
 
-        if (!positionsForBuilding.empty()) return true;
+        for (int k = 0; x > 0 && k < size; k++)                 if (isEmpty(x - 1, y + k))        positionsForBuilding.push_back(Vec2Int(x - 1, y + k));
+        for (int k = 0; x + size < MAP_SIZE && k < size; k++)   if (isEmpty(x + size, y + k))     positionsForBuilding.push_back(Vec2Int(x + size, y + k));
+        for (int k = 0; y > 0 && k < size; k++)                 if (isEmpty(x + k, y - 1))        positionsForBuilding.push_back(Vec2Int(x + k, y - 1));
+        for (int k = 0; y + size < MAP_SIZE && k < size; k++)   if (isEmpty(x + k, y + size))     positionsForBuilding.push_back(Vec2Int(x + k, y + size));
     }
 
-    return false;
+    return found;
 }
 
 /*
 ===================
-SearchPlaceForBuilding
+ReferenceSearchForEnemies
+
+Ranged units and turrets take their focus fire target or the first enemy in range, the others the nearest one
 ===================
 */
-bool SearchPlaceForBuilding(const PlayerView &playerView, const Entity &builder, Vec2Int &position, vector<Vec2Int> &positionsForBuilding, EntityType type, int fromBase = 0, buildingAlign_t align = ALIGN_IN_CORNER)
+bool ReferenceSearchForEnemies(const PlayerView &playerView, const Entity &entity, Vec2Int &position, int &targetId, int range, const vector<EntityType> &preferedTypes)
 {
-    auto checkPlace = [](const PlayerView &playerView, const Entity &builder, tile_t (&map)[MAP_SIZE][MAP_SIZE], int x, int y, Vec2Int &position, vector<Vec2Int> &positionsForBuilding, EntityType type)
-    {
-        int size = playerView.entityProperties.at(type).size;
-        bool canBuild = true;
-        positionsForBuilding.clear();
+    const Entity *inRange = nullptr;
+    const Entity *nearest = nullptr;
+    int minDistance = numeric_limits<int>::max();
 
-        if (x < 0 || y < 0 || x >= MAP_SIZE - size || y >= MAP_SIZE - size) return false;
+    for (const auto &enemy : playerView.entities)
+    {
+        if (!enemy.playerId || *enemy.playerId == playerView.myId)
+            continue;
 
-        buildMap[builder.position.x][builder.position.y] = TILE_EMPTY;
+        if (!preferedTypes.empty() && find(preferedTypes.begin(), preferedTypes.end(), enemy.entityType) == preferedTypes.end())
+            continue;
 
-        for (int i = x; i < x + size; i++)
-            for (int j = y; j < y + size; j++)
-                if (buildMap[i][j] != TILE_EMPTY)
-                    canBuild = false;
+        int dx = enemy.position.x - entity.position.x;
+        int dy = enemy.position.y - entity.position.y;
 
-        if (canBuild)
-        {   
-            position.x = x;
-            position.y = y;
+        if (!inRange && (entity.entityType == RANGED_UNIT || entity.entityType == TURRET) && ReferenceIsAtRange(playerView, entity, enemy.position, playerView.entityProperties.at(entity.entityType).attack->attackRange))
+            inRange = &enemy;
 
-            for (int k = 0; x > 0 && k < size; k++)                 if (buildMap[x - 1][y + k] == TILE_EMPTY)        positionsForBuilding.push_back(Vec2Int(x - 1, y + k));
-            for (int k = 0; x + size < MAP_SIZE && k < size; k++)   if (buildMap[x + size][y + k] == TILE_EMPTY)     positionsForBuilding.push_back(Vec2Int(x + size, y + k));
-            for (int k = 0; y > 0 && k < size; k++)                 if (buildMap[x + k][y - 1] == TILE_EMPTY)        positionsForBuilding.push_back(Vec2Int(x + k, y - 1));
-            for (int k = 0; y + size < MAP_SIZE && k < size; k++)   if (buildMap[x + k][y + size] == TILE_EMPTY)     positionsForBuilding.push_back(Vec2Int(x + k, y + size));
+        if (Distance(entity.position, enemy.position) <= range && dx * dx + dy * dy < minDistance)
+        {
+            minDistance = dx * dx + dy * dy;
+            nearest = &enemy;
         }
+    }
 
-        buildMap[builder.position.x][builder.position.y] = TILE_BLOCKED;
-        return canBuild;
-    };
+    auto focus = focusTargets.find(entity.id);
 
-    switch (align)
-    {
-        case ALIGN_IN_CORNER:
-        {
-            for (int n = fromBase; n < MAP_SIZE; n++)
-            {
-                for (int i = 0, j = n; i <= n && j >= 0; i++, j--)
-                {
-                    if (checkPlace(playerView, builder, buildMap, i, j, position, positionsForBuilding, type))
-                        return true;
-                }
-            }
+    if (focus != focusTargets.end() && focus->second.target != -1 && (preferedTypes.empty() || find(preferedTypes.begin(), preferedTypes.end(), playerView.entities[focus->second.target].entityType) != preferedTypes.end()))
+        inRange = &playerView.entities[focus->second.target];
 
-            break;
-        }
-        case ALIGN_IN_CORNER_CENTER:
-        {
-            for (int n = fromBase; n < MAP_SIZE; n++)
-            {
-                for (int i = n / 2, j = n / 2, i2 = n / 2, j2 = n / 2; i <= n && j >= 0 && i2 >= 0 && j2 <= n; i++, j--, i2--, j2++)
-                {
-                    if (checkPlace(playerView, builder, buildMap, i, j, position, positionsForBuilding, type))
-                        return true;
-                    else if (checkPlace(playerView, builder, buildMap, i2, j2, position, positionsForBuilding, type))
-                        return true;
-                }
-            }
+    if (inRange)
+        nearest = inRange;
 
-            break;
-        }
-        case ALIGN_AROUND_BUILDER:
+    if (!nearest)
+        return false;
+
+    position = nearest->position;
+    targetId = nearest->id;
+    return true;
+}
+
+/*
+===================
+ReferenceIsItWorthToAttack
+===================
+*/
+bool ReferenceIsItWorthToAttack(const PlayerView &playerView, const Entity &fromEntity, int allyRange, int enemyRange)
+{
+    int allyScore = 0;
+    int enemyScore = 0;
+    vector<int> counted;
+
+    for (const auto &enemy : playerView.entities)
+    {
+        if (enemy.playerId && *enemy.playerId != playerView.myId && (enemy.entityType == MELEE_UNIT || enemy.entityType == RANGED_UNIT))
         {
-            for (int n = 0; n < MAP_SIZE; n++)
+            if (fromEntity.entityType == RANGED_UNIT && enemy.entityType == RANGED_UNIT && ReferenceIsAtRange(playerView, fromEntity, enemy.position, ranged_dontRunAwayFromRanged)) return true;
+            if (fromEntity.entityType == RANGED_UNIT && enemy.entityType == MELEE_UNIT && ReferenceIsAtRange(playerView, fromEntity, enemy.position, ranged_dontRunAwayFromMelee)) return true;
+            if (fromEntity.entityType == MELEE_UNIT && enemy.entityType == RANGED_UNIT && ReferenceIsAtRange(playerView, fromEntity, enemy.position, melee_dontRunAwayFromRanged)) return true;
+            if (fromEntity.entityType == MELEE_UNIT && enemy.entityType == MELEE_UNIT && ReferenceIsAtRange(playerView, fromEntity, enemy.position, melee_dontRunAwayFromMelee)) return true;
+
+            if (ReferenceIsAtRange(playerView, fromEntity, enemy.position, allyRange))
             {
-                for (int i = builder.position.x - n; i <= builder.position.x + n; i++)
+                if (enemy.entityType == MELEE_UNIT) enemyScore += (int)(enemy.health * enemyMeleeRunAwayMultiplier);
+                else if (enemy.entityType == RANGED_UNIT) enemyScore += (int)(enemy.health * enemyRangedRunAwayMultiplier);
+
+                for (const auto &ally : playerView.entities)
                 {
-                    for (int j = builder.position.y - n; j <= builder.position.y + n; j++)
+                    if (ally.playerId && *ally.playerId == playerView.myId && (ally.entityType == MELEE_UNIT || ally.entityType == RANGED_UNIT))
                     {
-                        if (checkPlace(playerView, builder, buildMap, i, j, position, positionsForBuilding, type))
-                            return true;
+                        if (ReferenceIsAtRange(playerView, enemy, ally.position, enemyRange))
+                        {
+                            if (territoryField[enemy.position.x][enemy.position.y] < territoryField[ally.position.x][ally.position.y])
+                                return true;
+
+                            if (find(counted.begin(), counted.end(), ally.id) == counted.end())
+                            {
+                                counted.push_back(ally.id);
+
+                                if (ally.entityType == MELEE_UNIT) allyScore += (int)(ally.health * allyMeleeRunAwayMultiplier);
+                                else if (ally.entityType == RANGED_UNIT) allyScore += (int)(ally.health * allyRangedRunAwayMultiplier);
+                            }
+                        }
                     }
                 }
             }
-
-            break;
         }
     }
 
-    return false;
+    if (allyScore >= enemyScore)
+        return true;
+    else
+        return false;
 }
 
 /*
 ===================
-SearchForResources
+ReferenceMakeTerritory
 ===================
 */
-bool SearchForResources(const PlayerView &playerView, const Entity &builder, Vec2Int &targetPosition, int &targetId, const int range = numeric_limits<int>::max())
+void ReferenceMakeTerritory(const bitset<MAP_SIZE> (&sources)[MAP_SIZE], const bitset<MAP_SIZE> (&blocked)[MAP_SIZE], int (&field)[MAP_SIZE][MAP_SIZE])
 {
-    int path[MAP_SIZE][MAP_SIZE];
-    float nearestDistance = numeric_limits<float>::max();
-    vector<Vec2Int> positions;
+    vector<Vec2Int> queue;
 
     for (int i = 0; i < MAP_SIZE; i++)
     {
         for (int j = 0; j < MAP_SIZE; j++)
         {
-            if (worldMap[i][j] == TILE_EMPTY)
-            {
-                path[i][j] = PATH_EMPTY;
-            }
-            else
-            {
-                path[i][j] = PATH_BLOCKED;
-            }
+            field[i][j] = sources[i][j] ? 0 : territoryFar;
+
+            if (sources[i][j])
+                queue.push_back(Vec2Int(i, j));
         }
     }
-    
-    path[builder.position.x][builder.position.y] = PATH_START;
 
-    for (const auto &entity : playerView.entities)
-        if (entity.entityType == RESOURCE)
-            path[entity.position.x][entity.position.y] = PATH_TARGET;
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+        Vec2Int cell = queue[head];
+        Vec2Int neighbours[4] = { Vec2Int(cell.x - 1, cell.y), Vec2Int(cell.x + 1, cell.y), Vec2Int(cell.x, cell.y - 1), Vec2Int(cell.x, cell.y + 1) };
 
-    if (SearchPath(playerView, path, positions, range))
+        for (const auto &neighbour : neighbours)
+        {
+            if (neighbour.x < 0 || neighbour.y < 0 || neighbour.x >= MAP_SIZE || neighbour.y >= MAP_SIZE)
+                continue;
+
+            if (blocked[neighbour.x][neighbour.y] || field[neighbour.x][neighbour.y] != territoryFar)
+                continue;
+
+            field[neighbour.x][neighbour.y] = field[cell.x][cell.y] + 1;
+            queue.push_back(neighbour);
+        }
+    }
+}
+#endif
+
+/*
+===================
+GetDistances
+
+Distances from one position to all the positions of the list
+===================
+*/
+void GetDistances(const Vec2Int &from, const positionList_t &positions, distance_t metric, int *distances)
+{
+    const int *xs = positions.x.data();
+    const int *ys = positions.y.data();
+    int size = positions.Size();
+    int i = 0;
+
+#if defined(__AVX2__)
+    __m256i fromX = _mm256_set1_epi32(from.x);
+    __m256i fromY = _mm256_set1_epi32(from.y);
+
+    for (; i + 8 <= size; i += 8)
     {
-        for (const auto &position : positions)
+        __m256i dx = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(xs + i)), fromX);
+        __m256i dy = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(ys + i)), fromY);
+        __m256i distance = metric == DISTANCE_SQUARED ? _mm256_add_epi32(_mm256_mullo_epi32(dx, dx), _mm256_mullo_epi32(dy, dy)) : _mm256_add_epi32(_mm256_abs_epi32(dx), _mm256_abs_epi32(dy));
+        _mm256_storeu_si256((__m256i *)(distances + i), distance);
+    }
+#elif defined(__SSE4_1__)
+    __m128i fromX = _mm_set1_epi32(from.x);
+    __m128i fromY = _mm_set1_epi32(from.y);
+
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i dx = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(xs + i)), fromX);
+        __m128i dy = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(ys + i)), fromY);
+        __m128i distance = metric == DISTANCE_SQUARED ? _mm_add_epi32(_mm_mullo_epi32(dx, dx), _mm_mullo_epi32(dy, dy)) : _mm_add_epi32(_mm_abs_epi32(dx), _mm_abs_epi32(dy));
+        _mm_storeu_si128((__m128i *)(distances + i), distance);
+    }
+#endif
+
+    for (; i < size; i++)
+    {
+        int dx = xs[i] - from.x;
+        int dy = ys[i] - from.y;
+        distances[i] = metric == DISTANCE_SQUARED ? dx * dx + dy * dy : abs(dx) + abs(dy);
+    }
+}
+
+/*
+===================
+GetNearestIndex
+
+The first position of the list with the smallest distance, or -1 when the list is empty
+===================
+*/
+int GetNearestIndex(const Vec2Int &from, const positionList_t &positions, distance_t metric, int *nearestDistance = nullptr)
+{
+    const int *xs = positions.x.data();
+    const int *ys = positions.y.data();
+    int size = positions.Size();
+    int nearest = -1;
+    int minDistance = numeric_limits<int>::max();
+    int i = 0;
+
+#if defined(__AVX2__)
+    if (size >= 8)
+    {
+        __m256i fromX = _mm256_set1_epi32(from.x);
+        __m256i fromY = _mm256_set1_epi32(from.y);
+        __m256i minDistances = _mm256_set1_epi32(numeric_limits<int>::max());
+        __m256i minIndices = _mm256_set1_epi32(-1);
+        __m256i indices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i step = _mm256_set1_epi32(8);
+
+        for (; i + 8 <= size; i += 8)
         {
-            float distance = Distance(builder.position, position);
+            __m256i dx = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(xs + i)), fromX);
+            __m256i dy = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(ys + i)), fromY);
+            __m256i distance = metric == DISTANCE_SQUARED ? _mm256_add_epi32(_mm256_mullo_epi32(dx, dx), _mm256_mullo_epi32(dy, dy)) : _mm256_add_epi32(_mm256_abs_epi32(dx), _mm256_abs_epi32(dy));
+
+            // Strictly smaller, so every lane keeps its first minimum
+            __m256i smaller = _mm256_cmpgt_epi32(minDistances, distance);
+            minDistances = _mm256_blendv_epi8(minDistances, distance, smaller);
+            minIndices = _mm256_blendv_epi8(minIndices, indices, smaller);
+            indices = _mm256_add_epi32(indices, step);
+        }
 
-            if (distance < nearestDistance)
+        int laneDistances[8];
+        int laneIndices[8];
+        _mm256_storeu_si256((__m256i *)laneDistances, minDistances);
+        _mm256_storeu_si256((__m256i *)laneIndices, minIndices);
+
+        for (int lane = 0; lane < 8; lane++)
+        {
+            if (laneIndices[lane] != -1 && (laneDistances[lane] < minDistance || laneDistances[lane] == minDistance && laneIndices[lane] < nearest))
             {
-                nearestDistance = distance;
-                targetPosition.x = position.x;
-                targetPosition.y = position.y;
+                minDistance = laneDistances[lane];
+                nearest = laneIndices[lane];
+            }
+        }
+    }
+#elif defined(__SSE4_1__)
+    if (size >= 4)
+    {
+        __m128i fromX = _mm_set1_epi32(from.x);
+        __m128i fromY = _mm_set1_epi32(from.y);
+        __m128i minDistances = _mm_set1_epi32(numeric_limits<int>::max());
+        __m128i minIndices = _mm_set1_epi32(-1);
+        __m128i indices = _mm_setr_epi32(0, 1, 2, 3);
+        __m128i step = _mm_set1_epi32(4);
+
+        for (; i + 4 <= size; i += 4)
+        {
+            __m128i dx = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(xs + i)), fromX);
+            __m128i dy = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(ys + i)), fromY);
+            __m128i distance = metric == DISTANCE_SQUARED ? _mm_add_epi32(_mm_mullo_epi32(dx, dx), _mm_mullo_epi32(dy, dy)) : _mm_add_epi32(_mm_abs_epi32(dx), _mm_abs_epi32(dy));
+
+            // Strictly smaller, so every lane keeps its first minimum
+            __m128i smaller = _mm_cmpgt_epi32(minDistances, distance);
+            minDistances = _mm_blendv_epi8(minDistances, distance, smaller);
+            minIndices = _mm_blendv_epi8(minIndices, indices, smaller);
+            indices = _mm_add_epi32(indices, step);
+        }
+
+        int laneDistances[4];
+        int laneIndices[4];
+        _mm_storeu_si128((__m128i *)laneDistances, minDistances);
+        _mm_storeu_si128((__m128i *)laneIndices, minIndices);
 
-                for (const auto &entity : playerView.entities)
-                    if (entity.position.x == position.x && entity.position.y == position.y)
-                        targetId = entity.id;
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (laneIndices[lane] != -1 && (laneDistances[lane] < minDistance || laneDistances[lane] == minDistance && laneIndices[lane] < nearest))
+            {
+                minDistance = laneDistances[lane];
+                nearest = laneIndices[lane];
             }
         }
+    }
+#endif
 
-        return true;
+    for (; i < size; i++)
+    {
+        int dx = xs[i] - from.x;
+        int dy = ys[i] - from.y;
+        int distance = metric == DISTANCE_SQUARED ? dx * dx + dy * dy : abs(dx) + abs(dy);
+
+        if (distance < minDistance)
+        {
+            minDistance = distance;
+            nearest = i;
+        }
     }
 
-    return false;
+    if (nearestDistance) *nearestDistance = minDistance;
+    return nearest;
 }
 
 /*
 ===================
-SearchForEnemies
+CountInRange
+
+Number of positions of the list with the distance equal or less than the range
 ===================
 */
-bool SearchForEnemies(const PlayerView &playerView, const Entity &entity, Vec2Int &position, int &targetId, int range = numeric_limits<int>::max(), const vector<EntityType> &preferedTypes = vector<EntityType>())
+int CountInRange(const Vec2Int &from, const positionList_t &positions, distance_t metric, int range)
 {
-    bool found = false;
-    float MinDistance = numeric_limits<float>::max();
-    int lowestHealth = numeric_limits<int>::max();
+    const int *xs = positions.x.data();
+    const int *ys = positions.y.data();
+    int size = positions.Size();
+    int count = 0;
+    int i = 0;
+
+#if defined(__AVX2__)
+    __m256i fromX = _mm256_set1_epi32(from.x);
+    __m256i fromY = _mm256_set1_epi32(from.y);
+    __m256i maxDistance = _mm256_set1_epi32(range);
+
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i dx = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(xs + i)), fromX);
+        __m256i dy = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(ys + i)), fromY);
+        __m256i distance = metric == DISTANCE_SQUARED ? _mm256_add_epi32(_mm256_mullo_epi32(dx, dx), _mm256_mullo_epi32(dy, dy)) : _mm256_add_epi32(_mm256_abs_epi32(dx), _mm256_abs_epi32(dy));
+        count += 8 - __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(distance, maxDistance))));
+    }
+#elif defined(__SSE4_1__)
+    __m128i fromX = _mm_set1_epi32(from.x);
+    __m128i fromY = _mm_set1_epi32(from.y);
+    __m128i maxDistance = _mm_set1_epi32(range);
 
-    for (const auto &enemy : playerView.entities)
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i dx = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(xs + i)), fromX);
+        __m128i dy = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(ys + i)), fromY);
+        __m128i distance = metric == DISTANCE_SQUARED ? _mm_add_epi32(_mm_mullo_epi32(dx, dx), _mm_mullo_epi32(dy, dy)) : _mm_add_epi32(_mm_abs_epi32(dx), _mm_abs_epi32(dy));
+        count += 4 - __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(distance, maxDistance))));
+    }
+#endif
+
+    for (; i < size; i++)
+    {
+        int dx = xs[i] - from.x;
+        int dy = ys[i] - from.y;
+        int distance = metric == DISTANCE_SQUARED ? dx * dx + dy * dy : abs(dx) + abs(dy);
+
+        if (distance <= range)
+            count++;
+    }
+
+    return count;
+}
+
+/*
+===================
+MakeSectorPyramid
+
+Counts the entities of both sides in the sectors of every level, the entities of the finest sectors are kept for the edges of the queries
+===================
+*/
+void MakeSectorPyramid(const PlayerView &playerView)
+{
+    const int finest = sectorSizes[0];
+    const int finestPerSide = MAP_SIZE / finest;
+
+    for (int level = 0; level < NUM_SECTOR_LEVELS; level++)
+    {
+        int perSide = MAP_SIZE / sectorSizes[level];
+        sectorLevels[level].assign(perSide * perSide, sector_t());
+    }
+
+    for (int i = 0; i <= finestPerSide * finestPerSide; i++)
+        sectorStarts[i] = 0;
+
+    for (const auto &entity : playerView.entities)
+        if (entity.playerId)
+            sectorStarts[(entity.position.x / finest) * finestPerSide + entity.position.y / finest + 1]++;
+
+    for (int i = 0; i < finestPerSide * finestPerSide; i++)
+        sectorStarts[i + 1] += sectorStarts[i];
+
+    sectorEntities.resize(sectorStarts[finestPerSide * finestPerSide]);
+    vector<int> next(sectorStarts, sectorStarts + finestPerSide * finestPerSide);
+
+    for (int index = 0; index < (int)playerView.entities.size(); index++)
     {
-        if (!enemy.playerId || enemy.entityType == RESOURCE || *enemy.playerId == playerView.myId)
+        const Entity &entity = playerView.entities[index];
+
+        if (!entity.playerId)
             continue;
 
-        if (!preferedTypes.empty())
+        int sector = (entity.position.x / finest) * finestPerSide + entity.position.y / finest;
+        int owner = *entity.playerId == playerView.myId ? PLAYER_ALLY : PLAYER_ENEMY;
+
+        sectorEntities[next[sector]++] = { entity.position.x, entity.position.y, owner, entity.entityType, index };
+
+        for (int level = 0; level < NUM_SECTOR_LEVELS; level++)
+        {
+            int perSide = MAP_SIZE / sectorSizes[level];
+            sector_t &aggregate = sectorLevels[level][(entity.position.x / sectorSizes[level]) * perSide + entity.position.y / sectorSizes[level]];
+
+            aggregate.types[owner] |= 1u << entity.entityType;
+            aggregate.counts[owner][entity.entityType]++;
+        }
+    }
+}
+
+/*
+===================
+QueryRegion
+
+Number of the entities of the player and the types within the range, whole sectors are summed and only the sectors on the edge are checked one entity after another
+===================
+*/
+int QueryRegion(const Vec2Int &center, int squaredRange, player_t player, unsigned int types)
+{
+    int count = 0;
+    int range = min((int)ceil(sqrt((double)max(squaredRange, 0))), 2 * MAP_SIZE);
+    int level = NUM_SECTOR_LEVELS - 1;
+
+    if (squaredRange < 0)
+        return count;
+
+    // The coarsest level with the sectors not bigger than the range
+    while (level > 0 && sectorSizes[level] > range)
+        level--;
+
+    auto squaredDistances = [&](int x0, int y0, int size, int &minDistance, int &maxDistance)
+    {
+        int nearX = max(0, max(x0 - center.x, center.x - (x0 + size - 1)));
+        int nearY = max(0, max(y0 - center.y, center.y - (y0 + size - 1)));
+        int farX = max(abs(center.x - x0), abs(center.x - (x0 + size - 1)));
+        int farY = max(abs(center.y - y0), abs(center.y - (y0 + size - 1)));
+
+        minDistance = nearX * nearX + nearY * nearY;
+        maxDistance = farX * farX + farY * farY;
+    };
+
+    auto addSector = [&](const sector_t &sector)
+    {
+        for (unsigned int present = sector.types[player] & types; present; present &= present - 1)
+            count += sector.counts[player][__builtin_ctz(present)];
+    };
+
+    auto visitFinest = [&](int sx, int sy)
+    {
+        const int size = sectorSizes[0];
+        int minDistance, maxDistance;
+        int sector = sx * (MAP_SIZE / size) + sy;
+
+        if (!(sectorLevels[0][sector].types[player] & types))
+            return;
+
+        squaredDistances(sx * size, sy * size, size, minDistance, maxDistance);
+
+        if (minDistance > squaredRange)
+            return;
+
+        if (maxDistance <= squaredRange)
         {
-            bool exclude = true;
+            addSector(sectorLevels[0][sector]);
+            return;
+        }
 
-            for (const auto &preferedType : preferedTypes)
-                if (enemy.entityType == preferedType)
-                    exclude = false;
+        for (int i = sectorStarts[sector]; i < sectorStarts[sector + 1]; i++)
+        {
+            const sectorEntity_t &entity = sectorEntities[i];
+            int dx = entity.x - center.x;
+            int dy = entity.y - center.y;
 
-            if (exclude) continue;
+            if (entity.owner == player && (types & (1u << entity.type)) && dx * dx + dy * dy <= squaredRange)
+                count++;
         }
+    };
 
-        float enemyDistance = Distance(entity.position, enemy.position);
+    const int size = sectorSizes[level];
+    const int perSide = MAP_SIZE / size;
+    const int ratio = size / sectorSizes[0];
 
-        if (entity.entityType == RANGED_UNIT || entity.entityType == TURRET)
+    for (int sx = max(0, (center.x - range) / size); sx <= min(perSide - 1, (center.x + range) / size); sx++)
+    {
+        for (int sy = max(0, (center.y - range) / size); sy <= min(perSide - 1, (center.y + range) / size); sy++)
         {
-            if (entity.health < lowestHealth && IsAtRange(playerView, entity, enemy.position, playerView.entityProperties.at(entity.entityType).attack->attackRange))
+            int minDistance, maxDistance;
+
+            // Sectors without the types are skipped on every level
+            if (!(sectorLevels[level][sx * perSide + sy].types[player] & types))
+                continue;
+
+            squaredDistances(sx * size, sy * size, size, minDistance, maxDistance);
+
+            if (minDistance > squaredRange)
+                continue;
+
+            if (maxDistance <= squaredRange)
             {
-                lowestHealth = entity.health;
-                position.x = enemy.position.x;
-                position.y = enemy.position.y;
-                targetId = enemy.id;
-                found = true;
+                addSector(sectorLevels[level][sx * perSide + sy]);
+                continue;
             }
+
+            for (int fx = sx * ratio; fx < (sx + 1) * ratio; fx++)
+                for (int fy = sy * ratio; fy < (sy + 1) * ratio; fy++)
+                    visitFinest(fx, fy);
+        }
+    }
+
+    return count;
+}
+
+/*
+===================
+AnyInRegion
+===================
+*/
+bool AnyInRegion(const Vec2Int &center, int range, player_t player, unsigned int types = allEntityTypes)
+{
+    return QueryRegion(center, SquaredRange(range), player, types) > 0;
+}
+
+/*
+===================
+ForEachInSectors
+
+Visits the entities of the player and the types in the finest sectors that overlap the box, the exact range is checked by the caller
+===================
+*/
+template <typename Function>
+void ForEachInSectors(const PlayerView &playerView, int minX, int minY, int maxX, int maxY, player_t player, unsigned int types, Function function)
+{
+    const int size = sectorSizes[0];
+    const int perSide = MAP_SIZE / size;
+
+    for (int sx = max(0, minX) / size; sx <= min(MAP_SIZE - 1, maxX) / size; sx++)
+    {
+        for (int sy = max(0, minY) / size; sy <= min(MAP_SIZE - 1, maxY) / size; sy++)
+        {
+            int sector = sx * perSide + sy;
+
+            if (!(sectorLevels[0][sector].types[player] & types))
+                continue;
+
+            for (int i = sectorStarts[sector]; i < sectorStarts[sector + 1]; i++)
+                if (sectorEntities[i].owner == player && (types & (1u << sectorEntities[i].type)))
+                    function(playerView.entities[sectorEntities[i].index]);
         }
+    }
+}
+
+/*
+===================
+IsAtRange
+===================
+*/
+bool IsAtRange(const PlayerView &playerView, const Entity &entity, const Vec2Int &target, const int range)
+{
+    int entitySize = playerView.entityProperties.at(entity.entityType).size;
+    int dx = max(0, max(entity.position.x - target.x, target.x - (entity.position.x + entitySize - 1)));
+    int dy = max(0, max(entity.position.y - target.y, target.y - (entity.position.y + entitySize - 1)));
+    bool atRange = dx + dy <= range;
+
+#ifdef ORACLE_VALIDATION
+    OracleCheck(playerView, atRange == ReferenceIsAtRange(playerView, entity, target, range), "IsAtRange");
+#endif
+
+    return atRange;
+}
+
+/*
+===================
+GetStencil
+
+Cells within the range from any cell of a footprint, every column of it is a single span
+===================
+*/
+const vector<stencilSpan_t> &GetStencil(int size, int range)
+{
+    auto it = stencils.find(make_pair(size, range));
+
+    if (it != stencils.end())
+        return it->second;
+
+    vector<stencilSpan_t> &stencil = stencils[make_pair(size, range)];
+
+    for (int x = -range; x < size + range; x++)
+    {
+        int rest = range - max(0, max(-x, x - (size - 1)));
+        stencil.push_back({ x, -rest, size - 1 + rest });
+    }
+
+    return stencil;
+}
+
+/*
+===================
+StampStencil
+===================
+*/
+void StampStencil(const vector<stencilSpan_t> &stencil, const Vec2Int &position, bitset<MAP_SIZE> (&mask)[MAP_SIZE])
+{
+    static const bitset<MAP_SIZE> ones = bitset<MAP_SIZE>().set();
+
+    for (const auto &span : stencil)
+    {
+        int x = position.x + span.x;
+        int minY = max(0, position.y + span.minY);
+        int maxY = min(MAP_SIZE - 1, position.y + span.maxY);
+
+        if (x < 0 || x >= MAP_SIZE || minY > maxY)
+            continue;
+
+        mask[x] |= (ones >> (MAP_SIZE - (maxY - minY + 1))) << minY;
+    }
+}
+
+/*
+===================
+MakeVisibilityMask
+
+Cells within the sight range of our entities
+===================
+*/
+void MakeVisibilityMask(const PlayerView &playerView)
+{
+    for (int i = 0; i < MAP_SIZE; i++)
+        visibilityMask[i].reset();
+
+    for (const auto &entity : playerView.entities)
+    {
+        if (!entity.playerId || *entity.playerId != playerView.myId) continue;
+
+        const EntityProperties &properties = playerView.entityProperties.at(entity.entityType);
+        StampStencil(GetStencil(properties.size, properties.sightRange), entity.position, visibilityMask);
+    }
+}
+
+/*
+===================
+GetFarthestDistance
+
+Truncated Euclidean distance to the farthest position of the list
+===================
+*/
+int GetFarthestDistance(const Vec2Int &from, const positionList_t &positions)
+{
+    static vector<int> distances;
+    int maxDistance = 0;
+
+    distances.resize(positions.Size());
+    GetDistances(from, positions, DISTANCE_SQUARED, distances.data());
+
+    for (int distance : distances)
+        maxDistance = max(maxDistance, distance);
+
+    return (int)sqrtf((float)maxDistance);
+}
+
+/*
+===================
+GetNearestPosition
+===================
+*/
+bool GetNearestPosition(const Vec2Int &from, const vector<Vec2Int> &positions, Vec2Int &nearestPosition)
+{
+    static positionList_t list;
+    list.Clear();
+
+    for (const auto &position : positions)
+        list.Add(position);
+
+    int nearest = GetNearestIndex(from, list, DISTANCE_SQUARED);
+
+    if (nearest == -1)
+        return false;
+
+    nearestPosition.x = positions[nearest].x;
+    nearestPosition.y = positions[nearest].y;
+    return true;
+}
+
+/*
+===================
+GetSpawnPoints
+===================
+*/
+void GetSpawnPoints(const PlayerView &playerView, const Entity &spawnObject, const tile_t (&map)[MAP_SIZE][MAP_SIZE], vector<Vec2Int> &spawns)
+{
+    spawns.clear();
+    int x = spawnObject.position.x;
+    int y = spawnObject.position.y;
+    int size = playerView.entityProperties.at(spawnObject.entityType).size;
+
+    for (int k = 0; x > 0 && k < size; k++)                  if (map[x - 1][y + k] == TILE_EMPTY)      spawns.push_back(Vec2Int(x - 1, y + k));
+    for (int k = 0; x + size < MAP_SIZE && k < size; k++)    if (map[x + size][y + k] == TILE_EMPTY)   spawns.push_back(Vec2Int(x + size, y + k));
+    for (int k = 0; y > 0 && k < size; k++)                  if (map[x + k][y - 1] == TILE_EMPTY)      spawns.push_back(Vec2Int(x + k, y - 1));
+    for (int k = 0; y + size < MAP_SIZE && k < size; k++)    if (map[x + k][y + size] == TILE_EMPTY)   spawns.push_back(Vec2Int(x + k, y + size));
+}
+
+/*
+===================
+GetNumberOfTroops
+===================
+*/
+int GetNumberOfTroops(const Entity &fromEntity, const player_t player, int range = numeric_limits<int>::max())
+{
+    return QueryRegion(fromEntity.position, SquaredRange(range), player, troopTypes);
+}
+
+/*
+===================
+GetBuildingIndent
+===================
+*/
+int GetBuildingIndent(const PlayerView &playerView, EntityType type, const Vec2Int &position)
+{
+    int size = playerView.entityProperties.at(type).size;
+
+    if (!playerView.fogOfWar)
+        return buildingIndent;
+
+    // We don't need an indent when a house is located on the border of the map
+    if (type == HOUSE)
+    {
+        if (position.x == 0 && position.y == 0)
+            return 0;
+        else if (position.x == 0 && position.y > size)
+            return 0;
+        else if (position.y == 0 && position.x > size + 1)
+            return 0;
+    }
+
+    return buildingIndentWithFog;
+}
+
+/*
+===================
+StampBuilding
+===================
+*/
+void StampBuilding(const PlayerView &playerView, tile_t (&map)[MAP_SIZE][MAP_SIZE], EntityType type, const Vec2Int &position)
+{
+    int size = playerView.entityProperties.at(type).size;
+    int indent = GetBuildingIndent(playerView, type, position);
+
+    for (int x = 0; x < size + indent * 2; x++)
+        for (int y = 0; y < size + indent * 2; y++)
+            if (position.x + x - indent >= 0 && position.x + x - indent < MAP_SIZE && position.y + y - indent >= 0 && position.y + y - indent < MAP_SIZE)
+                map[position.x + x - indent][position.y + y - indent] = TILE_BLOCKED;
+}
+
+/*
+===================
+MakeMap
+===================
+*/
+void MakeMap(const PlayerView &playerView, tile_t (&map)[MAP_SIZE][MAP_SIZE], bool forBuilding = false, bool withUnits = true)
+{
+#ifdef ORACLE_VALIDATION
+    static thread_local tile_t reference[MAP_SIZE][MAP_SIZE];
+    memcpy(reference, map, sizeof(reference));
+#endif
+
+    // Removes old data from the map, resource tiles out of sight are remembered in the fog of war
+    if (playerView.fogOfWar)
+    {
+        for (int i = 0; i < MAP_SIZE; i++)
+            for (int j = 0; j < MAP_SIZE; j++)
+                if (map[i][j] != TILE_DESTROYABLE || visibilityMask[i][j])
+                    map[i][j] = TILE_EMPTY;
+    }
+    else
+    {
+        for (int i = 0; i < MAP_SIZE; i++)
+            for (int j = 0; j < MAP_SIZE; j++)
+                map[i][j] = TILE_EMPTY;
+    }
+
+    // Mapping
+    for (const auto &entity : playerView.entities)
+    {
+        const EntityProperties &properties = playerView.entityProperties.at(entity.entityType);
+
+        if (!withUnits && properties.canMove)
+            continue;
+
+        // Adds an indent to our buildings for building
+        if (forBuilding && (entity.entityType == BUILDER_BASE || entity.entityType == MELEE_BASE || entity.entityType == RANGED_BASE || entity.entityType == HOUSE || entity.entityType == TURRET))
+        {
+            StampBuilding(playerView, map, entity.entityType, entity.position);
+        }
+        else
+        {
+            for (int x = 0; x < properties.size; x++)
+            {
+                for (int y = 0; y < properties.size; y++)
+                {
+                    if (entity.entityType == RESOURCE)
+                        map[entity.position.x + x][entity.position.y + y] = TILE_DESTROYABLE;
+                    else
+                        map[entity.position.x + x][entity.position.y + y] = TILE_BLOCKED;
+                }
+            }
+        }
+    }
+
+#ifdef ORACLE_VALIDATION
+    ReferenceMakeMap(playerView, reference, forBuilding, withUnits);
+    OracleCheck(playerView, !memcmp(reference, map, sizeof(reference)), "MakeMap");
+#endif
+}
+
+/*
+===================
+SearchPath
+===================
+*/
+template <typename T, gridLayout_t layout>
+bool SearchPath(const PlayerView &playerView, grid_t<T, layout> &map, vector<Vec2Int> &targetPositions, int range = numeric_limits<int>::max())
+{
+    // The labels have to fit into the cell type
+    const int maxPath = (int)numeric_limits<T>::max() - 8;
+    int path = 0;
+    bool result;
+    targetPositions.clear();
+
+#ifdef ORACLE_VALIDATION
+    static thread_local int reference[MAP_SIZE][MAP_SIZE];
+    vector<Vec2Int> referencePositions;
+
+    for (int i = 0; i < MAP_SIZE; i++)
+        for (int j = 0; j < MAP_SIZE; j++)
+            reference[i][j] = map(i, j);
+#endif
+
+    auto label = [&](T &cell)
+    {
+        if (cell == PATH_EMPTY)                 cell = (T)(path + 1);
+        else if (cell == PATH_TARGET)           cell = PATH_TARGET_FOUND;
+        // It takes approximately 7 ticks for destroying a resource
+        else if (cell == PATH_DESTROYABLE)      cell = (T)(path + 8);
+    };
+
+    while (1)
+    {
+        bool stopSearch = true;
+        bool found = false;
+
+        if (path > range || path > maxPath)
+        {
+            result = !targetPositions.empty();
+            break;
+        }
+
+        map.ForEach([&](int i, int j, T &cell)
+        {
+            if (cell == path)
+            {
+                if (i > 0)                  label(map(i - 1, j));
+                if (i < MAP_SIZE - 1)       label(map(i + 1, j));
+                if (j > 0)                  label(map(i, j - 1));
+                if (j < MAP_SIZE - 1)       label(map(i, j + 1));
+
+                stopSearch = false;
+#ifdef GAME_TELEMETRY
+                searchCellsExpanded++;
+#endif
+            }
+        });
+
+        map.ForEach([&](int i, int j, T &cell)
+        {
+            if (cell == PATH_TARGET_FOUND)
+            {
+                cell = (T)(path + 1);
+                targetPositions.push_back(Vec2Int(i, j));
+                found = true;
+            }
+        });
+
+        if (found || stopSearch)
+        {
+            result = found;
+            break;
+        }
+
+        path++;
+    }
+
+#ifdef ORACLE_VALIDATION
+    bool match = ReferenceSearchPath(reference, referencePositions, range, maxPath) == result;
+
+    for (int i = 0; i < MAP_SIZE; i++)
+        for (int j = 0; j < MAP_SIZE; j++)
+            match = match && reference[i][j] == map(i, j);
+
+    // The tiled layout finds the targets in another order
+    auto byCell = [](const Vec2Int &a, const Vec2Int &b) { return a.x < b.x || (a.x == b.x && a.y < b.y); };
+    vector<Vec2Int> positions = targetPositions;
+    sort(positions.begin(), positions.end(), byCell);
+    match = match && SamePositions(positions, referencePositions);
+
+    OracleCheck(playerView, match, "SearchPath");
+#endif
+
+    return result;
+}
+
+/*
+===================
+DispatchRepairs
+
+Walks from the free cells around every damaged building to the builders, the closest builders are sent to each building
+===================
+*/
+void DispatchRepairs(const PlayerView &playerView, bool meleeBaseFirst)
+{
+    struct repairCandidate_t
+    {
+        int priority;
+        int distance;
+        int builder;
+        int building;
+        Vec2Int slot;
+    };
+
+    static positionIndex_t builderIndices;
+    static int distances[MAP_SIZE][MAP_SIZE];
+    static Vec2Int origins[MAP_SIZE][MAP_SIZE];
+    static int stamps[MAP_SIZE][MAP_SIZE];
+    static int stamp;
+    static vector<Vec2Int> queue;
+    static vector<repairCandidate_t> candidates;
+    static vector<int> crews;
+    const positionList_t &builders = allyPositions[BUILDER_UNIT];
+
+    repairAssignments.clear();
+    candidates.clear();
+
+    if (!damagedBuildings.Size() || !builders.Size())
+        return;
+
+    builderIndices.Set(builders);
+
+    for (int building = 0; building < damagedBuildings.Size(); building++)
+    {
+        const Entity &entity = playerView.entities[damagedBuildings.index[building]];
+        int size = playerView.entityProperties.at(entity.entityType).size;
+        int range = entity.entityType == MELEE_BASE ? MAP_SIZE * 2 : builderRepairDistance;
+        size_t head = 0;
+
+        if (entity.entityType == MELEE_BASE && !meleeBaseFirst)
+            continue;
+
+        stamp++;
+        queue.clear();
+
+        auto visit = [&](int x, int y, int distance, const Vec2Int &origin)
+        {
+            if (x < 0 || x >= MAP_SIZE || y < 0 || y >= MAP_SIZE || stamps[x][y] == stamp)
+                return;
+
+            if (moveMap(x, y) != PATH_EMPTY && builderIndices(x, y) == -1)
+                return;
+
+            stamps[x][y] = stamp;
+            distances[x][y] = distance;
+            origins[x][y] = origin;
+            queue.push_back(Vec2Int(x, y));
+        };
+
+        // The builders standing next to the building are at their slots already
+        for (int k = 0; k < size; k++)
+        {
+            visit(entity.position.x - 1, entity.position.y + k, 0, Vec2Int(entity.position.x - 1, entity.position.y + k));
+            visit(entity.position.x + size, entity.position.y + k, 0, Vec2Int(entity.position.x + size, entity.position.y + k));
+            visit(entity.position.x + k, entity.position.y - 1, 0, Vec2Int(entity.position.x + k, entity.position.y - 1));
+            visit(entity.position.x + k, entity.position.y + size, 0, Vec2Int(entity.position.x + k, entity.position.y + size));
+        }
+
+        while (head < queue.size())
+        {
+            Vec2Int cell = queue[head++];
+            int distance = distances[cell.x][cell.y];
+
+            if (builderIndices(cell.x, cell.y) != -1)
+                candidates.push_back({ entity.entityType == MELEE_BASE ? 0 : 1, distance, builderIndices(cell.x, cell.y), building, origins[cell.x][cell.y] });
+
+            // The builders that stand still block the way
+            if (distance >= range || moveMap(cell.x, cell.y) != PATH_EMPTY)
+                continue;
+
+            visit(cell.x + 1, cell.y, distance + 1, origins[cell.x][cell.y]);
+            visit(cell.x - 1, cell.y, distance + 1, origins[cell.x][cell.y]);
+            visit(cell.x, cell.y + 1, distance + 1, origins[cell.x][cell.y]);
+            visit(cell.x, cell.y - 1, distance + 1, origins[cell.x][cell.y]);
+        }
+    }
+
+    builderIndices.Reset(builders);
+
+    // The melee base goes first while there's no ranged base, then the closest pairs
+    sort(candidates.begin(), candidates.end(), [](const repairCandidate_t &a, const repairCandidate_t &b)
+    {
+        if (a.priority != b.priority) return a.priority < b.priority;
+        if (a.distance != b.distance) return a.distance < b.distance;
+        return a.builder < b.builder;
+    });
+
+    crews.assign(damagedBuildings.Size(), 0);
+
+    for (const auto &candidate : candidates)
+    {
+        int builderId = playerView.entities[builders.index[candidate.builder]].id;
+
+        if (crews[candidate.building] >= numberOfBuildersForRepair || repairAssignments.find(builderId) != repairAssignments.end())
+            continue;
+
+        crews[candidate.building]++;
+        repairAssignments[builderId] = { playerView.entities[damagedBuildings.index[candidate.building]].id, candidate.slot };
+    }
+}
+
+/*
+===================
+GetRepairAssignment
+===================
+*/
+bool GetRepairAssignment(const Entity &builder, int &targetId, Vec2Int &slot)
+{
+    auto it = repairAssignments.find(builder.id);
+
+    if (it == repairAssignments.end())
+        return false;
+
+    targetId = it->second.targetId;
+    slot = it->second.slot;
+    return true;
+}
+
+/*
+===================
+CheckPlaceForBuilding
+===================
+*/
+bool CheckPlaceForBuilding(const PlayerView &playerView, const Entity *builder, int x, int y, Vec2Int &position, vector<Vec2Int> &positionsForBuilding, EntityType type, tile_t (&map)[MAP_SIZE][MAP_SIZE] = buildMap)
+{
+    int size = playerView.entityProperties.at(type).size;
+    bool canBuild = true;
+    positionsForBuilding.clear();
+
+    if (x < 0 || y < 0 || x >= MAP_SIZE - size || y >= MAP_SIZE - size) return false;
+
+    // The builder can stand on the place it's going to build
+    if (builder) map[builder->position.x][builder->position.y] = TILE_EMPTY;
+
+    for (int i = x; i < x + size; i++)
+        for (int j = y; j < y + size; j++)
+            if (map[i][j] != TILE_EMPTY)
+                canBuild = false;
+
+    if (canBuild)
+    {   
+        position.x = x;
+        position.y = y;
+
+        for (int k = 0; x > 0 && k < size; k++)                 if (map[x - 1][y + k] == TILE_EMPTY)        positionsForBuilding.push_back(Vec2Int(x - 1, y + k));
+        for (int k = 0; x + size < MAP_SIZE && k < size; k++)   if (map[x + size][y + k] == TILE_EMPTY)     positionsForBuilding.push_back(Vec2Int(x + size, y + k));
+        for (int k = 0; y > 0 && k < size; k++)                 if (map[x + k][y - 1] == TILE_EMPTY)        positionsForBuilding.push_back(Vec2Int(x + k, y - 1));
+        for (int k = 0; y + size < MAP_SIZE && k < size; k++)   if (map[x + k][y + size] == TILE_EMPTY)     positionsForBuilding.push_back(Vec2Int(x + k, y + size));
+    }
+
+    if (builder) map[builder->position.x][builder->position.y] = TILE_BLOCKED;
+    return canBuild;
+}
+
+/*
+===================
+ScanPlacesForBuilding
+===================
+*/
+bool ScanPlacesForBuilding(const PlayerView &playerView, const Entity *builder, Vec2Int &position, vector<Vec2Int> &positionsForBuilding, EntityType type, int fromBase, buildingAlign_t align, tile_t (&map)[MAP_SIZE][MAP_SIZE])
+{
+    switch (align)
+    {
+        case ALIGN_IN_CORNER:
+        {
+            for (int n = fromBase; n < MAP_SIZE; n++)
+            {
+                for (int i = 0, j = n; i <= n && j >= 0; i++, j--)
+                {
+                    if (CheckPlaceForBuilding(playerView, builder, i, j, position, positionsForBuilding, type, map))
+                        return true;
+                }
+            }
+
+            break;
+        }
+        case ALIGN_IN_CORNER_CENTER:
+        {
+            for (int n = fromBase; n < MAP_SIZE; n++)
+            {
+                for (int i = n / 2, j = n / 2, i2 = n / 2, j2 = n / 2; i <= n && j >= 0 && i2 >= 0 && j2 <= n; i++, j--, i2--, j2++)
+                {
+                    if (CheckPlaceForBuilding(playerView, builder, i, j, position, positionsForBuilding, type, map))
+                        return true;
+                    else if (CheckPlaceForBuilding(playerView, builder, i2, j2, position, positionsForBuilding, type, map))
+                        return true;
+                }
+            }
+
+            break;
+        }
+        case ALIGN_AROUND_BUILDER:
+        {
+            // The planned buildings have no builder to search around
+            if (!builder)
+                return false;
+
+            for (int n = 0; n < MAP_SIZE; n++)
+            {
+                for (int i = builder->position.x - n; i <= builder->position.x + n; i++)
+                {
+                    for (int j = builder->position.y - n; j <= builder->position.y + n; j++)
+                    {
+                        if (CheckPlaceForBuilding(playerView, builder, i, j, position, positionsForBuilding, type, map))
+                            return true;
+                    }
+                }
+            }
+
+            break;
+        }
+    }
+
+    return false;
+}
+
+/*
+===================
+SearchPlaceForBuilding
+===================
+*/
+bool SearchPlaceForBuilding(const PlayerView &playerView, const Entity *builder, Vec2Int &position, vector<Vec2Int> &positionsForBuilding, EntityType type, int fromBase = 0, buildingAlign_t align = ALIGN_IN_CORNER, tile_t (&map)[MAP_SIZE][MAP_SIZE] = buildMap)
+{
+#ifdef ORACLE_VALIDATION
+    Vec2Int referencePosition;
+    vector<Vec2Int> referencePositions;
+    bool referenceFound = ReferenceSearchPlaceForBuilding(playerView, builder, referencePosition, referencePositions, type, fromBase, align, map);
+#endif
+
+    bool found = ScanPlacesForBuilding(playerView, builder, position, positionsForBuilding, type, fromBase, align, map);
+
+#ifdef ORACLE_VALIDATION
+    OracleCheck(playerView, found == referenceFound && (!found || (position.x == referencePosition.x && position.y == referencePosition.y && SamePositions(positionsForBuilding, referencePositions))), "SearchPlaceForBuilding");
+#endif
+
+    return found;
+}
+
+/*
+===================
+MakeOpeningLayout
+
+Places the houses one after another on the map of the first tick without the units
+===================
+*/
+void MakeOpeningLayout(const PlayerView &playerView)
+{
+    static tile_t savedMap[MAP_SIZE][MAP_SIZE];
+    Vec2Int position;
+    vector<Vec2Int> positionsForBuilding;
+
+    memcpy(savedMap, buildMap, sizeof(savedMap));
+    MakeMap(playerView, buildMap, true, false);
+    openingLayout.clear();
+
+    while ((int)openingLayout.size() < openingLayoutHouses && SearchPlaceForBuilding(playerView, nullptr, position, positionsForBuilding, HOUSE))
+    {
+        openingLayout.push_back(position);
+        StampBuilding(playerView, buildMap, HOUSE, position);
+    }
+
+    memcpy(buildMap, savedMap, sizeof(buildMap));
+}
+
+/*
+===================
+PlanBuilding
+
+Reserves a place and the resources for a building, the nearest builder without a plan is assigned to it
+===================
+*/
+bool PlanBuilding(const PlayerView &playerView, EntityType type, int &resources, int fromBase = 0)
+{
+    static vector<int> distances;
+    const positionList_t &builders = allyPositions[BUILDER_UNIT];
+    buildPlan_t &plan = buildPlans[type];
+    int cost = playerView.entityProperties.at(type).buildScore;
+    int minDistance = numeric_limits<int>::max();
+
+    plan.builder = -1;
+
+    if (resources < cost)
+        return false;
+
+    // Houses take the first free place of the opening layout, the rest is searched on the live map
+    bool found = false;
+
+    if (type == HOUSE)
+        for (size_t i = 0; i < openingLayout.size() && !found; i++)
+            found = CheckPlaceForBuilding(playerView, nullptr, openingLayout[i].x, openingLayout[i].y, plan.position, plan.positionsForBuilding, HOUSE);
+
+#ifdef BACKGROUND_PRECOMPUTE
+    // The place found by the worker is taken when it's still free
+    if (type == HOUSE && !found && precomputed && precomputed->houseFound)
+        found = CheckPlaceForBuilding(playerView, nullptr, precomputed->house.x, precomputed->house.y, plan.position, plan.positionsForBuilding, HOUSE);
+#endif
+
+    if (!found && !SearchPlaceForBuilding(playerView, nullptr, plan.position, plan.positionsForBuilding, type, fromBase))
+        return false;
+
+    distances.resize(builders.Size());
+    GetDistances(plan.position, builders, DISTANCE_SQUARED, distances.data());
+
+    for (int i = 0; i < builders.Size(); i++)
+    {
+        int id = playerView.entities[builders.index[i]].id;
+        bool planned = false;
+
+        for (const auto &other : buildPlans)
+            if (&other != &plan && other.builder == id)
+                planned = true;
+
+        if (!planned && distances[i] < minDistance)
+        {
+            minDistance = distances[i];
+            plan.builder = id;
+        }
+    }
+
+    if (plan.builder == -1)
+        return false;
+
+    resources -= cost;
+    return true;
+}
+
+/*
+===================
+FindResourceCluster
+===================
+*/
+int FindResourceCluster(int cell)
+{
+    while (resourceClusters[cell].parent != cell)
+    {
+        resourceClusters[cell].parent = resourceClusters[resourceClusters[cell].parent].parent;
+        cell = resourceClusters[cell].parent;
+    }
+
+    return cell;
+}
+
+/*
+===================
+UpdateResourceFrontier
+
+A resource cell is on the frontier when one of its sides isn't a resource
+===================
+*/
+void UpdateResourceFrontier(int x, int y)
+{
+    if (x < 0 || x >= MAP_SIZE || y < 0 || y >= MAP_SIZE || !resourceMask[x][y])
+        return;
+
+    bool frontier = (x > 0 && !resourceMask[x - 1][y]) || (x < MAP_SIZE - 1 && !resourceMask[x + 1][y]) || (y > 0 && !resourceMask[x][y - 1]) || (y < MAP_SIZE - 1 && !resourceMask[x][y + 1]);
+
+    if (frontier != resourceFrontierMask[x][y])
+    {
+        resourceFrontierMask[x][y] = frontier;
+        resourceClusters[FindResourceCluster(x * MAP_SIZE + y)].frontier += frontier ? 1 : -1;
+    }
+}
+
+/*
+===================
+AddResource
+===================
+*/
+void AddResource(int x, int y)
+{
+    const int dx[] = { -1, 1, 0, 0 };
+    const int dy[] = { 0, 0, -1, 1 };
+    int cell = x * MAP_SIZE + y;
+
+    // A removed cell can still link its cluster, so it comes back into the same one
+    if (resourceNodeMask[x][y])
+    {
+        resourceClusters[FindResourceCluster(cell)].cells++;
+    }
+    else
+    {
+        resourceClusters[cell] = { cell, 1, 0 };
+        resourceNodeMask[x][y] = true;
+    }
+
+    resourceMask[x][y] = true;
+    numOfResourceCells++;
+
+    for (int k = 0; k < 4; k++)
+    {
+        int nx = x + dx[k];
+        int ny = y + dy[k];
+
+        if (nx < 0 || nx >= MAP_SIZE || ny < 0 || ny >= MAP_SIZE || !resourceMask[nx][ny])
+            continue;
+
+        int root = FindResourceCluster(cell);
+        int other = FindResourceCluster(nx * MAP_SIZE + ny);
+
+        if (root == other)
+            continue;
+
+        // Attaches the smaller cluster to the bigger one
+        if (resourceClusters[root].cells > resourceClusters[other].cells)
+            swap(root, other);
+
+        resourceCluster_t &from = resourceClusters[root];
+        resourceCluster_t &to = resourceClusters[other];
+        from.parent = other;
+        to.cells += from.cells;
+        to.frontier += from.frontier;
+    }
+
+    UpdateResourceFrontier(x, y);
+
+    for (int k = 0; k < 4; k++)
+        UpdateResourceFrontier(x + dx[k], y + dy[k]);
+}
+
+/*
+===================
+RemoveResource
+===================
+*/
+void RemoveResource(int x, int y)
+{
+    resourceCluster_t &root = resourceClusters[FindResourceCluster(x * MAP_SIZE + y)];
+
+    root.cells--;
+
+    if (resourceFrontierMask[x][y])
+        root.frontier--;
+
+    resourceMask[x][y] = false;
+    resourceFrontierMask[x][y] = false;
+    numOfResourceCells--;
+    numOfRemovedResources++;
+
+    UpdateResourceFrontier(x - 1, y);
+    UpdateResourceFrontier(x + 1, y);
+    UpdateResourceFrontier(x, y - 1);
+    UpdateResourceFrontier(x, y + 1);
+}
+
+/*
+===================
+ClearResourceIndex
+===================
+*/
+void ClearResourceIndex()
+{
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        resourceNodeMask[i].reset();
+        resourceMask[i].reset();
+        resourceFrontierMask[i].reset();
+    }
+
+    numOfResourceCells = 0;
+    numOfRemovedResources = 0;
+}
+
+/*
+===================
+UpdateResourceIndex
+
+Adds the new resources and removes the visible cells where they're gone
+===================
+*/
+void UpdateResourceIndex(const PlayerView &playerView)
+{
+    for (int i = 0; i < MAP_SIZE; i++)
+        for (int j = 0; j < MAP_SIZE; j++)
+            resourceIds[i][j] = -1;
+
+    for (const auto &entity : playerView.entities)
+        if (entity.entityType == RESOURCE)
+            resourceIds[entity.position.x][entity.position.y] = entity.id;
+
+    // Removed cells can split a cluster, so it's rebuilt from time to time
+    if (numOfRemovedResources >= resourceRebuildRemovals)
+    {
+        bitset<MAP_SIZE> cells[MAP_SIZE];
+
+        for (int i = 0; i < MAP_SIZE; i++)
+            cells[i] = resourceMask[i];
+
+        ClearResourceIndex();
+
+        for (int i = 0; i < MAP_SIZE; i++)
+            for (int j = 0; j < MAP_SIZE; j++)
+                if (cells[i][j])
+                    AddResource(i, j);
+    }
+
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        for (int j = 0; j < MAP_SIZE; j++)
+        {
+            if (resourceIds[i][j] != -1 && !resourceMask[i][j])
+                AddResource(i, j);
+            else if (resourceIds[i][j] == -1 && resourceMask[i][j] && (!playerView.fogOfWar || visibilityMask[i][j]))
+                RemoveResource(i, j);
+        }
+    }
+
+    numOfVisibleFrontier = 0;
+
+    for (const auto &entity : playerView.entities)
+        if (entity.entityType == RESOURCE && resourceFrontierMask[entity.position.x][entity.position.y])
+            numOfVisibleFrontier++;
+}
+
+/*
+===================
+SearchForResources
+
+Only the visible frontier cells can be reached, the inner cells aren't targets
+===================
+*/
+bool SearchForResources(const PlayerView &playerView, const Entity &builder, Vec2Int &targetPosition, int &targetId, const int range = numeric_limits<int>::max())
+{
+    static pathGrid_t path;
+    float nearestDistance = numeric_limits<float>::max();
+    int largestCluster = 0;
+    vector<Vec2Int> positions;
+
+    if (!numOfVisibleFrontier)
+        return false;
+
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        for (int j = 0; j < MAP_SIZE; j++)
+        {
+            if (resourceIds[i][j] != -1 && resourceFrontierMask[i][j])
+            {
+                path(i, j) = PATH_TARGET;
+            }
+            else if (worldMap[i][j] == TILE_EMPTY)
+            {
+                path(i, j) = PATH_EMPTY;
+            }
+            else
+            {
+                path(i, j) = PATH_BLOCKED;
+            }
+        }
+    }
+
+    path(builder.position.x, builder.position.y) = PATH_START;
+
+    if (SearchPath(playerView, path, positions, range))
+    {
+        // Prefers the bigger cluster when the distances are the same
+        for (const auto &position : positions)
+        {
+            float distance = Distance(builder.position, position);
+            int cluster = resourceClusters[FindResourceCluster(position.x * MAP_SIZE + position.y)].cells;
+
+            if (distance < nearestDistance || (distance == nearestDistance && cluster > largestCluster))
+            {
+                nearestDistance = distance;
+                largestCluster = cluster;
+                targetPosition.x = position.x;
+                targetPosition.y = position.y;
+                targetId = resourceIds[position.x][position.y];
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/*
+===================
+AllocateFocusFire
+
+Gives the targets to every ranged unit and turret at once, the enemies needing the least damage to be killed go first
+===================
+*/
+void AllocateFocusFire(const PlayerView &playerView)
+{
+    static positionIndex_t enemyIndices;
+    static vector<int> attackers;
+    vector<vector<int>> &attackerTargets = focusInRange;
+    static vector<int> targets;
+    static vector<vector<int>> targetAttackers;
+    static vector<int> targetSlots;
+    static vector<int> healths;
+    static vector<bool> assigned;
+
+    focusTargets.clear();
+
+    if (allyPositions[RANGED_UNIT].Size() + allyPositions[TURRET].Size() < focusFireMinAttackers)
+        return;
+
+    attackers.clear();
+    targets.clear();
+    targetSlots.assign(enemies.Size(), -1);
+
+    enemyIndices.Set(enemies);
+
+    // Enemies within the attack range of every attacker
+    for (int n = 0; n < allyPositions[RANGED_UNIT].Size() + allyPositions[TURRET].Size(); n++)
+    {
+        int index = n < allyPositions[RANGED_UNIT].Size() ? allyPositions[RANGED_UNIT].index[n] : allyPositions[TURRET].index[n - allyPositions[RANGED_UNIT].Size()];
+        const Entity &entity = playerView.entities[index];
+
+        if (!entity.active)
+            continue;
+
+        const EntityProperties &properties = playerView.entityProperties.at(entity.entityType);
+        int slot = (int)attackers.size();
+
+        focusTargets[entity.id] = { -1, slot };
+        attackers.push_back(index);
+
+        if (attackerTargets.size() < attackers.size())
+            attackerTargets.resize(attackers.size());
+
+        attackerTargets[slot].clear();
+
+        for (const auto &span : GetStencil(properties.size, properties.attack->attackRange))
+        {
+            int x = entity.position.x + span.x;
+
+            if (x < 0 || x >= MAP_SIZE)
+                continue;
+
+            for (int y = max(0, entity.position.y + span.minY); y <= min(MAP_SIZE - 1, entity.position.y + span.maxY); y++)
+            {
+                int target = enemyIndices(x, y);
+
+                if (target == -1)
+                    continue;
+
+                if (targetSlots[target] == -1)
+                {
+                    targetSlots[target] = (int)targets.size();
+                    targets.push_back(target);
+
+                    if (targetAttackers.size() < targets.size())
+                        targetAttackers.resize(targets.size());
+
+                    targetAttackers[targets.size() - 1].clear();
+                }
+
+                attackerTargets[slot].push_back(target);
+                targetAttackers[targetSlots[target]].push_back(slot);
+            }
+        }
+    }
+
+    enemyIndices.Reset(enemies);
+
+    if (targets.empty())
+        return;
+
+    auto damage = [&](int slot) { return playerView.entityProperties.at(playerView.entities[attackers[slot]].entityType).attack->damage; };
+    vector<int> order(targets.size());
+
+    healths.resize(targets.size());
+    assigned.assign(attackers.size(), false);
+
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        order[i] = (int)i;
+        healths[i] = playerView.entities[enemies.index[targets[i]]].health;
+    }
+
+    sort(order.begin(), order.end(), [&](int a, int b) { return healths[a] < healths[b] || (healths[a] == healths[b] && targets[a] < targets[b]); });
+
+    // Kills, the attackers with the fewest targets are taken first
+    for (int slot : order)
+    {
+        vector<int> &candidates = targetAttackers[slot];
+        int totalDamage = 0;
+
+        for (int attacker : candidates)
+            if (!assigned[attacker])
+                totalDamage += damage(attacker);
+
+        if (totalDamage < healths[slot])
+            continue;
+
+        sort(candidates.begin(), candidates.end(), [&](int a, int b) { return attackerTargets[a].size() < attackerTargets[b].size() || (attackerTargets[a].size() == attackerTargets[b].size() && a < b); });
+
+        for (size_t i = 0; i < candidates.size() && healths[slot] > 0; i++)
+        {
+            if (assigned[candidates[i]])
+                continue;
+
+            assigned[candidates[i]] = true;
+            healths[slot] -= damage(candidates[i]);
+            focusTargets[playerView.entities[attackers[candidates[i]]].id].target = enemies.index[targets[slot]];
+        }
+    }
+
+    // The rest wounds the enemies which are still alive
+    for (size_t attacker = 0; attacker < attackers.size(); attacker++)
+    {
+        int best = -1;
+
+        if (assigned[attacker] || attackerTargets[attacker].empty())
+            continue;
+
+        for (int target : attackerTargets[attacker])
+        {
+            int slot = targetSlots[target];
+
+            if (best == -1 || (healths[slot] > 0 && (healths[best] <= 0 || healths[slot] < healths[best])))
+                best = slot;
+        }
+
+        healths[best] -= damage((int)attacker);
+        focusTargets[playerView.entities[attackers[attacker]].id].target = enemies.index[targets[best]];
+    }
+}
+
+/*
+===================
+QueryEnemies
+
+Collects the nearest and the in-range enemies of every entity type in a single pass
+===================
+*/
+void QueryEnemies(const PlayerView &playerView, const Entity &entity, enemyQuery_t &query)
+{
+    static vector<int> distances;
+    auto focus = focusTargets.find(entity.id);
+    // The allocator has already found the enemies in range of its attackers
+    bool canAttackInRange = (entity.entityType == RANGED_UNIT || entity.entityType == TURRET) && focus == focusTargets.end();
+    int attackRange = canAttackInRange ? playerView.entityProperties.at(entity.entityType).attack->attackRange : 0;
+
+    for (int type = 0; type < NUM_ENTITY_TYPES; type++)
+        query.types[type] = enemyCandidates_t();
+
+    distances.resize(enemies.Size());
+    GetDistances(entity.position, enemies, DISTANCE_SQUARED, distances.data());
+
+    for (int i = 0; i < enemies.Size(); i++)
+    {
+        int index = enemies.index[i];
+        const Entity &enemy = playerView.entities[index];
+        enemyCandidates_t &candidates = query.types[enemy.entityType];
+
+        if (candidates.nearest == -1 || distances[i] < candidates.nearestSquaredDistance)
+        {
+            candidates.nearestSquaredDistance = distances[i];
+            candidates.nearest = index;
+        }
+
+        if (canAttackInRange && candidates.firstInRange == -1 && IsAtRange(playerView, entity, enemy.position, attackRange))
+            candidates.firstInRange = index;
+    }
+
+    if (focus != focusTargets.end())
+    {
+        for (int target : focusInRange[focus->second.slot])
+        {
+            int index = enemies.index[target];
+            enemyCandidates_t &candidates = query.types[playerView.entities[index].entityType];
+
+            if (candidates.firstInRange == -1 || index < candidates.firstInRange)
+                candidates.firstInRange = index;
+        }
+    }
+
+    query.done = true;
+}
+
+/*
+===================
+SearchForEnemies
+
+Picks an enemy from the query, it's evaluated only once per entity on the first call
+===================
+*/
+bool SearchForEnemies(const PlayerView &playerView, const Entity &entity, enemyQuery_t &query, Vec2Int &position, int &targetId, int range = numeric_limits<int>::max(), const vector<EntityType> &preferedTypes = vector<EntityType>())
+{
+    static const vector<EntityType> allTypes = { WALL, HOUSE, BUILDER_BASE, BUILDER_UNIT, MELEE_BASE, MELEE_UNIT, RANGED_BASE, RANGED_UNIT, TURRET };
+    const vector<EntityType> &types = preferedTypes.empty() ? allTypes : preferedTypes;
+    int inRange = -1;
+    int nearest = -1;
+    int minDistance = numeric_limits<int>::max();
+    int squaredRange = SquaredRange(range);
+
+    if (!query.done)
+        QueryEnemies(playerView, entity, query);
+
+    for (const auto &type : types)
+    {
+        const enemyCandidates_t &candidates = query.types[type];
+
+        // Ranged units and turrets prefer the enemies they can already shoot
+        if (candidates.firstInRange != -1 && (inRange == -1 || candidates.firstInRange < inRange))
+            inRange = candidates.firstInRange;
+
+        if (candidates.nearest != -1 && candidates.nearestSquaredDistance <= squaredRange && (candidates.nearestSquaredDistance < minDistance || (candidates.nearestSquaredDistance == minDistance && candidates.nearest < nearest)))
+        {
+            minDistance = candidates.nearestSquaredDistance;
+            nearest = candidates.nearest;
+        }
+    }
+
+    // The target of the focus fire goes first when it's one of the types
+    auto focus = focusTargets.find(entity.id);
+
+    if (focus != focusTargets.end() && focus->second.target != -1 && find(types.begin(), types.end(), playerView.entities[focus->second.target].entityType) != types.end())
+        inRange = focus->second.target;
+
+    if (inRange != -1)
+        nearest = inRange;
+
+#ifdef ORACLE_VALIDATION
+    Vec2Int referencePosition;
+    int referenceId = -1;
+    bool referenceFound = ReferenceSearchForEnemies(playerView, entity, referencePosition, referenceId, range, preferedTypes);
+    OracleCheck(playerView, referenceFound == (nearest != -1) && (nearest == -1 || playerView.entities[nearest].id == referenceId), "SearchForEnemies");
+#endif
+
+    if (nearest == -1)
+        return false;
+
+    position.x = playerView.entities[nearest].position.x;
+    position.y = playerView.entities[nearest].position.y;
+    targetId = playerView.entities[nearest].id;
+    return true;
+}
+
+/*
+===================
+GetFocusTarget
+
+The target of the focus fire overrides the target of the branch, so the planned kills land
+===================
+*/
+int GetFocusTarget(const PlayerView &playerView, const Entity &entity, int targetId)
+{
+    auto focus = focusTargets.find(entity.id);
+
+    if (focus == focusTargets.end() || focus->second.target == -1)
+        return targetId;
+
+    return playerView.entities[focus->second.target].id;
+}
+
+/*
+===================
+GetNearestEnemyPosition
+===================
+*/
+bool GetNearestEnemyPosition(const PlayerView &playerView, Vec2Int &position, const Vec2Int fromPosition = Vec2Int(0, 0))
+{
+    bool found = false;
+    float nearestDistance = numeric_limits<float>::max();
+
+    for (const auto &entity : playerView.entities)
+    {
+        if (entity.playerId && *entity.playerId != playerView.myId && (entity.entityType == MELEE_UNIT || entity.entityType == RANGED_UNIT))
+        {
+            float distance = Distance(fromPosition, entity.position);
+            if (distance < nearestDistance)
+            {
+                nearestDistance = distance;
+                position.x = entity.position.x;
+                position.y = entity.position.y;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+/*
+===================
+WeighFight
+
+Only the troops in the sectors around the entity can change the outcome, the order they are visited in doesn't matter
+===================
+*/
+bool WeighFight(const PlayerView &playerView, const Entity &fromEntity, int allyRange, int enemyRange)
+{
+    int allyScore = 0;
+    int enemyScore = 0;
+    bool worth = false;
+    vector<int> counted;
+    int fromSize = playerView.entityProperties.at(fromEntity.entityType).size;
+    int range = max(allyRange, max(max(ranged_dontRunAwayFromRanged, ranged_dontRunAwayFromMelee), max(melee_dontRunAwayFromRanged, melee_dontRunAwayFromMelee)));
+
+    ForEachInSectors(playerView, fromEntity.position.x - range, fromEntity.position.y - range, fromEntity.position.x + fromSize - 1 + range, fromEntity.position.y + fromSize - 1 + range, PLAYER_ENEMY, troopTypes, [&](const Entity &enemy)
+    {
+        if (worth)
+            return;
+
+        if (fromEntity.entityType == RANGED_UNIT && enemy.entityType == RANGED_UNIT && IsAtRange(playerView, fromEntity, enemy.position, ranged_dontRunAwayFromRanged)) { worth = true; return; }
+        if (fromEntity.entityType == RANGED_UNIT && enemy.entityType == MELEE_UNIT && IsAtRange(playerView, fromEntity, enemy.position, ranged_dontRunAwayFromMelee)) { worth = true; return; }
+        if (fromEntity.entityType == MELEE_UNIT && enemy.entityType == RANGED_UNIT && IsAtRange(playerView, fromEntity, enemy.position, melee_dontRunAwayFromRanged)) { worth = true; return; }
+        if (fromEntity.entityType == MELEE_UNIT && enemy.entityType == MELEE_UNIT && IsAtRange(playerView, fromEntity, enemy.position, melee_dontRunAwayFromMelee)) { worth = true; return; }
+
+        if (!IsAtRange(playerView, fromEntity, enemy.position, allyRange))
+            return;
+
+        if (enemy.entityType == MELEE_UNIT) enemyScore += (int)(enemy.health * enemyMeleeRunAwayMultiplier);
+        else if (enemy.entityType == RANGED_UNIT) enemyScore += (int)(enemy.health * enemyRangedRunAwayMultiplier);
+
+        int enemySize = playerView.entityProperties.at(enemy.entityType).size;
+
+        ForEachInSectors(playerView, enemy.position.x - enemyRange, enemy.position.y - enemyRange, enemy.position.x + enemySize - 1 + enemyRange, enemy.position.y + enemySize - 1 + enemyRange, PLAYER_ALLY, troopTypes, [&](const Entity &ally)
+        {
+            if (worth || !IsAtRange(playerView, enemy, ally.position, enemyRange))
+                return;
+
+            if (territoryField[enemy.position.x][enemy.position.y] < territoryField[ally.position.x][ally.position.y])
+            {
+                worth = true;
+                return;
+            }
+
+            if (find(counted.begin(), counted.end(), ally.id) == counted.end())
+            {
+                counted.push_back(ally.id);
+
+                if (ally.entityType == MELEE_UNIT) allyScore += (int)(ally.health * allyMeleeRunAwayMultiplier);
+                else if (ally.entityType == RANGED_UNIT) allyScore += (int)(ally.health * allyRangedRunAwayMultiplier);
+            }
+        });
+    });
+
+    return worth || allyScore >= enemyScore;
+}
+
+/*
+===================
+IsItWorthToAttack
+===================
+*/
+bool IsItWorthToAttack(const PlayerView &playerView, const Entity &fromEntity, int allyRange, int enemyRange)
+{
+    bool worth = WeighFight(playerView, fromEntity, allyRange, enemyRange);
+
+#ifdef ORACLE_VALIDATION
+    OracleCheck(playerView, worth == ReferenceIsItWorthToAttack(playerView, fromEntity, allyRange, enemyRange), "IsItWorthToAttack");
+#endif
+
+    return worth;
+}
+
+/*
+===================
+MakeMoveMap
+
+Path tiles that are the same for every move of the current tick
+===================
+*/
+void MakeMoveMap(const PlayerView &playerView)
+{
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        turretMask[i].reset();
+
+        for (int j = 0; j < MAP_SIZE; j++)
+        {
+            if (worldMap[i][j] == TILE_EMPTY)
+                moveMap(i, j) = PATH_EMPTY;
+            else if (worldMap[i][j] == TILE_DESTROYABLE)
+                moveMap(i, j) = PATH_DESTROYABLE;
+            else
+                moveMap(i, j) = PATH_BLOCKED;
+        }
+    }
+
+    for (const auto &entity : playerView.entities)
+    {
+        const EntityProperties &property = playerView.entityProperties.at(entity.entityType);
+
+        if (entity.entityType == RESOURCE) continue;
+
+        if (entity.playerId && *entity.playerId == playerView.myId && (entity.entityType == RANGED_UNIT || entity.entityType == MELEE_UNIT || entity.entityType == BUILDER_UNIT))
+        {
+            if (unitPositionsAtLastTick[entity.position.x][entity.position.y] != unitPositionsAtCurrentTick[entity.position.x][entity.position.y])
+                moveMap(entity.position.x, entity.position.y) = PATH_EMPTY;
+            else
+                moveMap(entity.position.x, entity.position.y) = PATH_BLOCKED;
+        }
+        else
+        {
+            for (int i = 0; i < property.size; i++)
+                for (int j = 0; j < property.size; j++)
+                    moveMap(entity.position.x + i, entity.position.y + j) = PATH_BLOCKED;
+        }
+
+        // Makes ally troops avoid enemy turrets
+        if (entity.playerId && *entity.playerId != playerView.myId && entity.entityType == TURRET)
+            StampStencil(GetStencil(property.size, property.attack->attackRange), entity.position, turretMask);
+    }
+}
+
+/*
+===================
+IsPathCellFree
+===================
+*/
+bool IsPathCellFree(const Vec2Int &cell)
+{
+    return moveMap(cell.x, cell.y) != PATH_BLOCKED && !turretMask[cell.x][cell.y];
+}
+
+/*
+===================
+TracePath
+
+Follows a finished search from the position down to a start cell
+===================
+*/
+void TracePath(const pathGrid_t &path, const Vec2Int &from, vector<Vec2Int> &cells)
+{
+    Vec2Int cell = from;
+    cells.push_back(cell);
+
+    while (path(cell.x, cell.y) > PATH_START && (int)cells.size() <= MAP_SIZE * MAP_SIZE)
+    {
+        // A destroyable tile is entered 8 steps after its neighbour, see SearchPath
+        int step = cells.size() > 1 && moveMap(cell.x, cell.y) == PATH_DESTROYABLE ? 8 : 1;
+        int previous = path(cell.x, cell.y) - step;
+
+        if (cell.x + 1 < MAP_SIZE && path(cell.x + 1, cell.y) == previous)    cell.x++;
+        else if (cell.y + 1 < MAP_SIZE && path(cell.x, cell.y + 1) == previous)    cell.y++;
+        else if (cell.x - 1 >= 0 && path(cell.x - 1, cell.y) == previous)    cell.x--;
+        else if (cell.y - 1 >= 0 && path(cell.x, cell.y - 1) == previous)    cell.y--;
+        else break;
+
+        cells.push_back(cell);
+    }
+}
+
+/*
+===================
+RepairPath
+
+Replaces the blocked part of a stored path with a local detour
+===================
+*/
+bool RepairPath(const PlayerView &playerView, const pathGrid_t &path, unitPath_t &unitPath, int blocked)
+{
+    static pathGrid_t repair;
+    vector<Vec2Int> positions;
+    vector<Vec2Int> detour;
+    const vector<Vec2Int> &cells = unitPath.cells;
+    int rejoin = blocked;
+
+    while (rejoin < (int)cells.size() - 1 && !IsPathCellFree(cells[rejoin]))
+        rejoin++;
+
+    repair = path;
+    repair(cells[0].x, cells[0].y) = PATH_BLOCKED;
+    repair(cells[rejoin].x, cells[rejoin].y) = PATH_START;
+    repair(cells[blocked - 1].x, cells[blocked - 1].y) = PATH_TARGET;
+
+    if (!SearchPath(playerView, repair, positions, pathRepairRange))
+        return false;
+
+    TracePath(repair, cells[blocked - 1], detour);
+
+    if (detour.back().x == cells[rejoin].x && detour.back().y == cells[rejoin].y)
+        detour.insert(detour.end(), cells.begin() + rejoin + 1, cells.end());
+    else if (detour.back().x != unitPath.target.x || detour.back().y != unitPath.target.y)
+        return false;
+
+    unitPath.cells.erase(unitPath.cells.begin() + blocked - 1, unitPath.cells.end());
+    unitPath.cells.insert(unitPath.cells.end(), detour.begin(), detour.end());
+    return true;
+}
+
+/*
+===================
+IsJumpForced
+
+Moving along x, the side cell can't be reached by the canonical path that turns earlier
+===================
+*/
+bool IsJumpForced(int x, int y, int dx, int side)
+{
+    return y + side >= 0 && y + side < MAP_SIZE && !jumpBlocked[x][y + side] && jumpBlocked[x - dx][y + side];
+}
+
+/*
+===================
+MakeJumpLine
+===================
+*/
+void MakeJumpLine(int y)
+{
+    for (int dir = 0; dir < 2; dir++)
+    {
+        int dx = dir ? -1 : 1;
+
+        for (int x = dx > 0 ? MAP_SIZE - 1 : 0; x >= 0 && x < MAP_SIZE; x -= dx)
+        {
+            int next = x + dx;
+            int8_t &jump = xJumps[dir][y][x];
+
+            if (next < 0 || next >= MAP_SIZE || jumpBlocked[next][y])
+                jump = 0;
+            else if (IsJumpForced(next, y, dx, 1) || IsJumpForced(next, y, dx, -1))
+                jump = 1;
+            else
+                jump = xJumps[dir][y][next] > 0 ? xJumps[dir][y][next] + 1 : xJumps[dir][y][next] - 1;
+        }
+    }
+}
+
+/*
+===================
+UpdateJumpTables
+
+A line along x depends on its own tiles and the tiles of the lines next to it, only those are remade
+===================
+*/
+void UpdateJumpTables()
+{
+    bitset<MAP_SIZE> changed;
+
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        bitset<MAP_SIZE> blocked = turretMask[i];
+
+        for (int j = 0; j < MAP_SIZE; j++)
+            if (moveMap(i, j) == PATH_BLOCKED || moveMap(i, j) == PATH_DESTROYABLE)
+                blocked[j] = true;
+
+        changed |= blocked ^ jumpBlocked[i];
+        jumpBlocked[i] = blocked;
+    }
+
+    if (!jumpTablesValid)
+    {
+        changed.set();
+        jumpTablesValid = true;
+    }
+
+    changed |= (changed << 1) | (changed >> 1);
+
+    for (int y = changed._Find_first(); y < MAP_SIZE; y = changed._Find_next(y))
+        MakeJumpLine(y);
+}
+
+/*
+===================
+JumpSearch
+
+A* over the jump points of 4-connected uniform cost terrain. The canonical paths move along y first
+and turn to x anywhere, moving along x they turn back to y only at forced neighbours.
+The start and the target may be walls in the tables, the target is checked explicitly
+===================
+*/
+bool JumpSearch(const Vec2Int &from, const Vec2Int &to, int maxLength, vector<Vec2Int> &cells)
+{
+    struct jumpNode_t
+    {
+        int f;
+        int g;
+        int state;
+    };
+
+    // The states are the cells with the direction they were entered from
+    static const int directions[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+    static int16_t costs[4 * MAP_SIZE * MAP_SIZE];
+    static int parents[4 * MAP_SIZE * MAP_SIZE];
+    static int stamps[4 * MAP_SIZE * MAP_SIZE];
+    static int stamp;
+    static vector<jumpNode_t> open;
+    auto byCost = [](const jumpNode_t &a, const jumpNode_t &b) { return a.f > b.f || (a.f == b.f && a.g < b.g); };
+    int goal = -1;
+
+    cells.clear();
+    open.clear();
+    stamp++;
+
+    if (from.x == to.x && from.y == to.y)
+        return false;
+
+    auto isTarget = [&](int x, int y) { return x == to.x && y == to.y; };
+
+    // Distance along x to the next stop, the target or the cell next to it are stops too
+    auto jumpX = [&](int x, int y, int dx)
+    {
+        int jump = xJumps[dx > 0 ? 0 : 1][y][x];
+        int distance = (to.x - x) * dx;
+        int stop = jump > 0 ? jump : 0;
+
+        if (distance > 0 && ((to.y == y && distance <= (jump > 0 ? jump : 1 - jump)) || (abs(to.y - y) == 1 && distance <= (jump > 0 ? jump : -jump))))
+            stop = stop ? min(stop, distance) : distance;
+
+        return stop;
+    };
+
+    auto push = [&](int x, int y, int direction, int g, int parent)
+    {
+        int state = direction * MAP_SIZE * MAP_SIZE + x * MAP_SIZE + y;
+        int f = g + abs(to.x - x) + abs(to.y - y);
+
+        if (f > maxLength || (stamps[state] == stamp && costs[state] <= g))
+            return;
+
+        stamps[state] = stamp;
+        costs[state] = (int16_t)g;
+        parents[state] = parent;
+        open.push_back({ f, g, state });
+        push_heap(open.begin(), open.end(), byCost);
+    };
+
+    auto jump = [&](int x, int y, int direction, int g, int parent)
+    {
+        int dx = directions[direction][0];
+        int dy = directions[direction][1];
+
+        if (dx)
+        {
+            int stop = jumpX(x, y, dx);
+
+            if (stop)
+                push(x + stop * dx, y, direction, g + stop, parent);
+
+            return;
+        }
+
+        for (int step = 1; y + step * dy >= 0 && y + step * dy < MAP_SIZE; step++)
+        {
+            int ny = y + step * dy;
+
+            if (isTarget(x, ny) || (!jumpBlocked[x][ny] && (jumpX(x, ny, 1) || jumpX(x, ny, -1))))
+            {
+                push(x, ny, direction, g + step, parent);
+                return;
+            }
+
+            if (jumpBlocked[x][ny])
+                return;
+        }
+    };
+
+    for (int direction = 0; direction < 4; direction++)
+        jump(from.x, from.y, direction, 0, -1);
+
+    while (!open.empty())
+    {
+        pop_heap(open.begin(), open.end(), byCost);
+        jumpNode_t node = open.back();
+        open.pop_back();
+
+        if (node.g > costs[node.state])
+            continue;
+
+#ifdef GAME_TELEMETRY
+        searchCellsExpanded++;
+#endif
+
+        int direction = node.state / (MAP_SIZE * MAP_SIZE);
+        int x = node.state / MAP_SIZE % MAP_SIZE;
+        int y = node.state % MAP_SIZE;
+        int dx = directions[direction][0];
+
+        if (isTarget(x, y))
+        {
+            goal = node.state;
+            break;
+        }
+
+        jump(x, y, direction, node.g, node.state);
+
+        if (dx)
+        {
+            if (IsJumpForced(x, y, dx, 1) || isTarget(x, y + 1))     jump(x, y, 2, node.g, node.state);
+            if (IsJumpForced(x, y, dx, -1) || isTarget(x, y - 1))    jump(x, y, 3, node.g, node.state);
+        }
+        else
+        {
+            jump(x, y, 0, node.g, node.state);
+            jump(x, y, 1, node.g, node.state);
+        }
+    }
+
+    // Fills the straight segments between the jump points
+    for (int state = goal; state != -1; state = parents[state])
+    {
+        int direction = state / (MAP_SIZE * MAP_SIZE);
+        Vec2Int cell(state / MAP_SIZE % MAP_SIZE, state % MAP_SIZE);
+        Vec2Int previous = parents[state] == -1 ? from : Vec2Int(parents[state] / MAP_SIZE % MAP_SIZE, parents[state] % MAP_SIZE);
+
+        while (cell.x != previous.x || cell.y != previous.y)
+        {
+            cells.push_back(cell);
+            cell.x -= directions[direction][0];
+            cell.y -= directions[direction][1];
+        }
+    }
+
+    if (goal != -1)
+    {
+        cells.push_back(from);
+        reverse(cells.begin(), cells.end());
+    }
+
+#ifdef ORACLE_VALIDATION
+    static int reference[MAP_SIZE][MAP_SIZE];
+    vector<Vec2Int> referencePositions;
+
+    for (int i = 0; i < MAP_SIZE; i++)
+        for (int j = 0; j < MAP_SIZE; j++)
+            reference[i][j] = jumpBlocked[i][j] ? PATH_BLOCKED : PATH_EMPTY;
+
+    reference[from.x][from.y] = PATH_TARGET;
+    reference[to.x][to.y] = PATH_START;
+
+    bool found = ReferenceSearchPath(reference, referencePositions, numeric_limits<int>::max(), numeric_limits<int>::max() - 8);
+    bool match = (found && reference[from.x][from.y] <= maxLength) == (goal != -1);
+
+    if (goal != -1)
+    {
+        match = match && reference[from.x][from.y] == (int)cells.size() - 1;
+
+        for (int i = 1; i < (int)cells.size(); i++)
+        {
+            match = match && abs(cells[i].x - cells[i - 1].x) + abs(cells[i].y - cells[i - 1].y) == 1;
+            match = match && (!jumpBlocked[cells[i].x][cells[i].y] || i == (int)cells.size() - 1);
+        }
+    }
+
+    OracleCheck(match, "JumpSearch");
+#endif
+
+    return goal != -1;
+}
+
+/*
+===================
+MakeReachLabels
+
+Two pass labelling of the runs of passable tiles along y, every run is joined with the runs it touches
+in the line before. The open tiles are the ones the jump tables don't block
+===================
+*/
+void MakeReachLabels()
+{
+    static int16_t parents[MAP_SIZE * MAP_SIZE / 2 + 1];
+    bitset<MAP_SIZE> passable[NUM_REACH_PROFILES][MAP_SIZE];
+
+    auto findRoot = [&](int16_t label)
+    {
+        while (parents[label] != label)
+        {
+            parents[label] = parents[parents[label]];
+            label = parents[label];
+        }
+
+        return label;
+    };
+
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        bitset<MAP_SIZE> blocked = turretMask[i];
+
+        for (int j = 0; j < MAP_SIZE; j++)
+            if (moveMap(i, j) == PATH_BLOCKED)
+                blocked[j] = true;
+
+        passable[REACH_MOVE][i] = ~blocked;
+        passable[REACH_OPEN][i] = ~jumpBlocked[i];
+    }
+
+    for (int profile = 0; profile < NUM_REACH_PROFILES; profile++)
+    {
+        int16_t (&labels)[MAP_SIZE][MAP_SIZE] = reachLabels[profile];
+        int16_t numOfLabels = 0;
+
+        for (int i = 0; i < MAP_SIZE; i++)
+        {
+            const bitset<MAP_SIZE> &line = passable[profile][i];
+            bitset<MAP_SIZE> starts = i > 0 ? passable[profile][i - 1] & ~(passable[profile][i - 1] << 1) : bitset<MAP_SIZE>();
+            int end = 0;
+
+            fill(labels[i], labels[i] + MAP_SIZE, 0);
+
+            for (int start = line._Find_first(); start < MAP_SIZE; start = line._Find_next(end))
+            {
+                end = min((int)(~line)._Find_next(start), MAP_SIZE);
+                numOfLabels++;
+                parents[numOfLabels] = numOfLabels;
+                fill(labels[i] + start, labels[i] + end, numOfLabels);
+
+                if (i == 0)
+                    continue;
+
+                // The run of the line before at the start, then every run starting under this one
+                for (int j = passable[profile][i - 1][start] ? start : (int)starts._Find_next(start); j < end; j = starts._Find_next(j))
+                {
+                    int16_t a = findRoot(numOfLabels);
+                    int16_t b = findRoot(labels[i - 1][j]);
+
+                    if (a != b)
+                        parents[max(a, b)] = min(a, b);
+                }
+
+                if (end == MAP_SIZE)
+                    break;
+            }
+        }
+
+        // The parents always have the lower labels, so the roots are resolved in one pass
+        parents[0] = 0;
+
+        for (int16_t label = 1; label <= numOfLabels; label++)
+            parents[label] = parents[parents[label]];
+
+        for (int i = 0; i < MAP_SIZE; i++)
+            for (int j = 0; j < MAP_SIZE; j++)
+                labels[i][j] = parents[labels[i][j]];
+    }
+}
+
+/*
+===================
+IsReachable
+
+A path has to join a passable tile next to the unit with one next to the target, unless they touch.
+The cells under the turrets are blocked, so is the target when it's the only cell of the unit.
+It never rejects a target the flood would reach, the flood may still stop at the destroyable tiles
+===================
+*/
+bool IsReachable(reachProfile_t profile, const Vec2Int &position, int size, const Vec2Int &target)
+{
+    const int16_t (&labels)[MAP_SIZE][MAP_SIZE] = reachLabels[profile];
+    int16_t unitLabels[4 * MAP_SIZE];
+    int numOfUnitLabels = 0;
+
+    if (turretMask[target.x][target.y])
+        return false;
+
+    auto addLabel = [&](int x, int y)
+    {
+        if (labels[x][y] > 0 && find(unitLabels, unitLabels + numOfUnitLabels, labels[x][y]) == unitLabels + numOfUnitLabels)
+            unitLabels[numOfUnitLabels++] = labels[x][y];
+    };
+
+    for (int x = position.x; x < position.x + size; x++)
+    {
+        for (int y = position.y; y < position.y + size; y++)
+        {
+            if ((x == target.x && y == target.y) || turretMask[x][y])
+                continue;
+
+            if (abs(x - target.x) + abs(y - target.y) == 1)
+                return true;
+
+            if (x > 0)                  addLabel(x - 1, y);
+            if (x < MAP_SIZE - 1)       addLabel(x + 1, y);
+            if (y > 0)                  addLabel(x, y - 1);
+            if (y < MAP_SIZE - 1)       addLabel(x, y + 1);
+        }
+    }
+
+    auto shared = [&](int x, int y)
+    {
+        return labels[x][y] > 0 && find(unitLabels, unitLabels + numOfUnitLabels, labels[x][y]) != unitLabels + numOfUnitLabels;
+    };
+
+    return (target.x > 0 && shared(target.x - 1, target.y)) || (target.x < MAP_SIZE - 1 && shared(target.x + 1, target.y)) ||
+           (target.y > 0 && shared(target.x, target.y - 1)) || (target.y < MAP_SIZE - 1 && shared(target.x, target.y + 1));
+}
+
+/*
+===================
+GetReachableTarget
+
+The target itself or the nearest tile the unit can walk to when the target is walled in, the unit's own tiles have no substitute
+===================
+*/
+bool GetReachableTarget(const PlayerView &playerView, const Entity &entity, const Vec2Int &target, Vec2Int &reachable)
+{
+    int size = playerView.entityProperties.at(entity.entityType).size;
+
+    if (target.x >= entity.position.x && target.x < entity.position.x + size && target.y >= entity.position.y && target.y < entity.position.y + size)
+        return false;
+
+    if (IsReachable(REACH_MOVE, entity.position, size, target))
+    {
+        reachable = target;
+        return true;
+    }
+
+    for (int range = 1; range < MAP_SIZE * 2; range++)
+    {
+        for (int dx = -range; dx <= range; dx++)
+        {
+            int dy = range - abs(dx);
+
+            for (int side = 0; side < (dy ? 2 : 1); side++)
+            {
+                Vec2Int cell(target.x + dx, target.y + (side ? -dy : dy));
+
+                if (cell.x < 0 || cell.y < 0 || cell.x >= MAP_SIZE || cell.y >= MAP_SIZE || !reachLabels[REACH_MOVE][cell.x][cell.y])
+                    continue;
+
+                if (IsReachable(REACH_MOVE, entity.position, size, cell))
+                {
+                    reachable = cell;
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+#ifdef GAME_TELEMETRY
+/*
+===================
+CountFailedMove
+===================
+*/
+void CountFailedMove(const Entity &entity)
+{
+    telemetry.failedMoves++;
+
+    if (entity.entityType == BUILDER_UNIT)
+        telemetry.blockedBuilders++;
+}
+#endif
+
+/*
+===================
+Move
+
+The unreachable targets are rejected by the labels before anything is flooded.
+The jump mode is for the long moves, it falls back to the flood when a destroyable tile could make a shorter path
+===================
+*/
+bool Move(const PlayerView &playerView, const Entity &entity, const Vec2Int &target, Vec2Int &move, pathMode_t mode = PATH_MODE_FLOOD)
+{
+    static pathGrid_t path;
+    const EntityProperties &properties = playerView.entityProperties.at(entity.entityType);
+    vector<Vec2Int> positions;
+    bool reachable = IsReachable(REACH_MOVE, entity.position, properties.size, target);
+
+#ifndef ORACLE_VALIDATION
+    if (!reachable)
+    {
+#ifdef GAME_TELEMETRY
+        CountFailedMove(entity);
+#endif
+        return false;
+    }
+#endif
+
+    path = moveMap;
+
+    for (int i = 0; i < properties.size; i++)
+        for (int j = 0; j < properties.size; j++)
+            path(entity.position.x + i, entity.position.y + j) = PATH_TARGET;
+
+    path(target.x, target.y) = PATH_START;
+
+    for (int i = 0; i < MAP_SIZE; i++)
+        if (turretMask[i].any())
+            for (int j = 0; j < MAP_SIZE; j++)
+                if (turretMask[i][j])
+                    path(i, j) = PATH_BLOCKED;
+
+#ifdef ORACLE_VALIDATION
+    if (!reachable)
+    {
+        static pathGrid_t flood;
+        flood = path;
+        OracleCheck(playerView, !SearchPath(playerView, flood, positions), "IsReachable");
+#ifdef GAME_TELEMETRY
+        CountFailedMove(entity);
+#endif
+        return false;
+    }
+#endif
+
+    // Reuses the path of the last ticks when it's still free, or repairs the blocked part of it
+    auto it = unitPaths.find(entity.id);
+
+    if (it != unitPaths.end() && it->second.target.x == target.x && it->second.target.y == target.y && playerView.currentTick - it->second.tick <= pathMaxAge && path(target.x, target.y) == PATH_START)
+    {
+        unitPath_t &unitPath = it->second;
+        vector<Vec2Int> &cells = unitPath.cells;
+        int position = 0;
+
+        while (position < (int)cells.size() && (cells[position].x != entity.position.x || cells[position].y != entity.position.y))
+            position++;
+
+        if (position + 1 < (int)cells.size())
+        {
+            int blocked = 1;
+            cells.erase(cells.begin(), cells.begin() + position);
+
+            while (blocked < (int)cells.size() - 1 && IsPathCellFree(cells[blocked]))
+                blocked++;
+
+            if (blocked == (int)cells.size() - 1 || RepairPath(playerView, path, unitPath, blocked))
+            {
+                move = cells[1];
+                return true;
+            }
+        }
+
+#ifdef GAME_TELEMETRY
+        telemetry.replans++;
+#endif
+    }
+
+    unitPaths.erase(entity.id);
+
+    // Going through a destroyable tile costs at least 7 more steps than the distance, longer paths are left to the flood
+    if (mode == PATH_MODE_JUMP && properties.size == 1 && path(target.x, target.y) == PATH_START && path(entity.position.x, entity.position.y) == PATH_TARGET && IsReachable(REACH_OPEN, entity.position, 1, target))
+    {
+        static vector<Vec2Int> cells;
+
+        if (JumpSearch(entity.position, target, abs(target.x - entity.position.x) + abs(target.y - entity.position.y) + 7, cells))
+        {
+            unitPath_t &unitPath = unitPaths[entity.id];
+            unitPath.target = target;
+            unitPath.tick = playerView.currentTick;
+            unitPath.cells = cells;
+            move = cells[1];
+            return true;
+        }
+    }
+
+    // Calculates the next move position
+    if (SearchPath(playerView, path, positions))
+    {
+        if (entity.position.x + 1 < MAP_SIZE && path(entity.position.x + 1, entity.position.y) == path(entity.position.x, entity.position.y) - 1)
+        {
+            move.x = entity.position.x + 1;
+            move.y = entity.position.y;
+        }
+        else if (entity.position.y + 1 < MAP_SIZE && path(entity.position.x, entity.position.y + 1) == path(entity.position.x, entity.position.y) - 1)
+        {
+            move.x = entity.position.x;
+            move.y = entity.position.y + 1;
+        }
+        else if (entity.position.x - 1 >= 0 && path(entity.position.x - 1, entity.position.y) == path(entity.position.x, entity.position.y) - 1)
+        {
+            move.x = entity.position.x - 1;
+            move.y = entity.position.y;
+        }
+        else if (entity.position.y - 1 >= 0 && path(entity.position.x, entity.position.y - 1) == path(entity.position.x, entity.position.y) - 1)
+        {
+            move.x = entity.position.x;
+            move.y = entity.position.y - 1;
+        }
+
+        if (properties.size == 1)
+        {
+            unitPath_t &unitPath = unitPaths[entity.id];
+            unitPath.target = target;
+            unitPath.tick = playerView.currentTick;
+            unitPath.cells.clear();
+            TracePath(path, entity.position, unitPath.cells);
+
+            if (unitPath.cells.size() < 2 || unitPath.cells.back().x != target.x || unitPath.cells.back().y != target.y)
+                unitPaths.erase(entity.id);
+        }
+
+        return true;
+    }
+
+#ifdef GAME_TELEMETRY
+    CountFailedMove(entity);
+#endif
+    return false;
+}
+
+/*
+===================
+DistanceTransform
+
+Two pass Manhattan distance transform, the seeds are 0 and the rest of the cells are big
+===================
+*/
+void DistanceTransform(int (&map)[MAP_SIZE][MAP_SIZE])
+{
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        for (int j = 0; j < MAP_SIZE; j++)
+        {
+            if (i > 0) map[i][j] = min(map[i][j], map[i - 1][j] + 1);
+            if (j > 0) map[i][j] = min(map[i][j], map[i][j - 1] + 1);
+        }
+    }
+
+    for (int i = MAP_SIZE - 1; i >= 0; i--)
+    {
+        for (int j = MAP_SIZE - 1; j >= 0; j--)
+        {
+            if (i < MAP_SIZE - 1) map[i][j] = min(map[i][j], map[i + 1][j] + 1);
+            if (j < MAP_SIZE - 1) map[i][j] = min(map[i][j], map[i][j + 1] + 1);
+        }
+    }
+}
+
+/*
+===================
+MakeSafetyMap
+
+Two pass distance transform from the cells taken by the enemy troops and turrets
+===================
+*/
+void MakeSafetyMap(const PlayerView &playerView)
+{
+    for (int i = 0; i < MAP_SIZE; i++)
+        for (int j = 0; j < MAP_SIZE; j++)
+            safetyMap[i][j] = MAP_SIZE * 2;
+
+    for (int i = 0; i < enemies.Size(); i++)
+    {
+        const Entity &enemy = playerView.entities[enemies.index[i]];
+
+        if (enemy.entityType != MELEE_UNIT && enemy.entityType != RANGED_UNIT && enemy.entityType != TURRET)
+            continue;
+
+        int size = playerView.entityProperties.at(enemy.entityType).size;
+
+        for (int x = enemy.position.x; x < enemy.position.x + size; x++)
+            for (int y = enemy.position.y; y < enemy.position.y + size; y++)
+                safetyMap[x][y] = 0;
+    }
+
+    DistanceTransform(safetyMap);
+}
+
+/*
+===================
+MakeResourceField
+===================
+*/
+void MakeResourceField()
+{
+    static vector<int> queue;
+    size_t head = 0;
+
+    queue.clear();
+
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        for (int j = 0; j < MAP_SIZE; j++)
+        {
+            if (resourceIds[i][j] != -1 && resourceFrontierMask[i][j])
+            {
+                resourceField[i][j] = 0;
+                queue.push_back(i * MAP_SIZE + j);
+            }
+            else
+            {
+                resourceField[i][j] = MAP_SIZE * MAP_SIZE;
+            }
+        }
+    }
+
+    while (head < queue.size())
+    {
+        int x = queue[head] / MAP_SIZE;
+        int y = queue[head] % MAP_SIZE;
+        int next = resourceField[x][y] + 1;
+        head++;
+
+        auto visit = [&](int i, int j)
+        {
+            if (worldMap[i][j] == TILE_EMPTY && resourceField[i][j] > next)
+            {
+                resourceField[i][j] = next;
+                queue.push_back(i * MAP_SIZE + j);
+            }
+        };
+
+        if (x > 0)                  visit(x - 1, y);
+        if (x < MAP_SIZE - 1)       visit(x + 1, y);
+        if (y > 0)                  visit(x, y - 1);
+        if (y < MAP_SIZE - 1)       visit(x, y + 1);
+    }
+}
+
+/*
+===================
+MakeEnemyField
+
+Falls back to the last known enemies and then to the enemy spawns when none are visible
+===================
+*/
+void MakeEnemyField()
+{
+    for (int i = 0; i < MAP_SIZE; i++)
+        for (int j = 0; j < MAP_SIZE; j++)
+            enemyField[i][j] = MAP_SIZE * 2;
+
+    if (enemies.Size())
+    {
+        for (int i = 0; i < enemies.Size(); i++)
+            enemyField[enemies.x[i]][enemies.y[i]] = 0;
+    }
+    else if (!knownEnemies.empty())
+    {
+        for (const auto &enemy : knownEnemies)
+            enemyField[enemy.x][enemy.y] = 0;
+    }
+    else
+    {
+        for (const auto &spawn : knownEnemySpawns)
+            enemyField[spawn.x][spawn.y] = 0;
+    }
+
+    DistanceTransform(enemyField);
+}
+
+/*
+===================
+UpdateTerritory
+
+The cells reached through a removed building or a new obstacle lose their distances, then the distances
+flow again from their neighbours, the new buildings and the opened tiles in the order of the distances
+===================
+*/
+void UpdateTerritory(const PlayerView &playerView)
+{
+    // Directions 0 and 1, 2 and 3 are the opposite ones
+    static const int dx[4] = { -1, 1, 0, 0 };
+    static const int dy[4] = { 0, 0, -1, 1 };
+    static const int numOfCells = MAP_SIZE * MAP_SIZE;
+    static vector<int> stack;
+    static vector<int> seeds;
+    static vector<int> queue;
+    bitset<MAP_SIZE> sources[MAP_SIZE];
+    bitset<MAP_SIZE> blocked[MAP_SIZE];
+    size_t head = 0;
+    size_t next = 0;
+
+    if (!territoryValid)
+    {
+        for (int i = 0; i < MAP_SIZE; i++)
+        {
+            fill(territoryField[i], territoryField[i] + MAP_SIZE, territoryFar);
+            fill(territoryParents[i], territoryParents[i] + MAP_SIZE, -1);
+            territorySources[i].reset();
+            territoryBlocked[i].reset();
+        }
+
+        territoryValid = true;
+    }
+
+    for (const auto type : { WALL, HOUSE, BUILDER_BASE, MELEE_BASE, RANGED_BASE, TURRET })
+    {
+        const positionList_t &buildings = allyPositions[type];
+        int size = playerView.entityProperties.at(type).size;
+
+        for (int n = 0; n < buildings.Size(); n++)
+            for (int x = buildings.x[n]; x < buildings.x[n] + size; x++)
+                for (int y = buildings.y[n]; y < buildings.y[n] + size; y++)
+                    sources[x][y] = true;
+    }
+
+    // The resources in the fog of war are remembered by the index too
+    for (int i = 0; i < MAP_SIZE; i++)
+        blocked[i] = resourceMask[i] & ~sources[i];
+
+    stack.clear();
+    seeds.clear();
+    queue.clear();
+
+    // Removed buildings and new obstacles take the subtrees of the cells reached through them
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        bitset<MAP_SIZE> lost = (territorySources[i] & ~sources[i]) | (blocked[i] & ~territoryBlocked[i]);
+
+        for (int j = lost._Find_first(); j < MAP_SIZE; j = lost._Find_next(j))
+        {
+            if (territoryField[i][j] == territoryFar)
+                continue;
+
+            territoryField[i][j] = territoryFar;
+            territoryParents[i][j] = -1;
+            stack.push_back(i * MAP_SIZE + j);
+        }
+    }
+
+    // The cleared cells are kept in the stack to be seeded again
+    for (size_t n = 0; n < stack.size(); n++)
+    {
+        int x = stack[n] / MAP_SIZE;
+        int y = stack[n] % MAP_SIZE;
+
+        for (int k = 0; k < 4; k++)
+        {
+            int i = x + dx[k];
+            int j = y + dy[k];
+
+            if (i < 0 || j < 0 || i >= MAP_SIZE || j >= MAP_SIZE || territoryParents[i][j] != (k ^ 1))
+                continue;
+
+            territoryField[i][j] = territoryFar;
+            territoryParents[i][j] = -1;
+            stack.push_back(i * MAP_SIZE + j);
+        }
+    }
+
+    // The tiles that opened up are seeded together with the cleared ones
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        bitset<MAP_SIZE> opened = territoryBlocked[i] & ~blocked[i] & ~sources[i];
+        bitset<MAP_SIZE> added = sources[i] & ~territorySources[i];
+
+        for (int j = opened._Find_first(); j < MAP_SIZE; j = opened._Find_next(j))
+            stack.push_back(i * MAP_SIZE + j);
+
+        for (int j = added._Find_first(); j < MAP_SIZE; j = added._Find_next(j))
+        {
+            territoryField[i][j] = 0;
+            territoryParents[i][j] = -1;
+            seeds.push_back(i * MAP_SIZE + j);
+        }
+
+        territorySources[i] = sources[i];
+        territoryBlocked[i] = blocked[i];
+    }
+
+    for (int cell : stack)
+    {
+        int x = cell / MAP_SIZE;
+        int y = cell % MAP_SIZE;
+
+        if (territoryBlocked[x][y] || territorySources[x][y])
+            continue;
+
+        for (int k = 0; k < 4; k++)
+        {
+            int i = x + dx[k];
+            int j = y + dy[k];
+
+            if (i < 0 || j < 0 || i >= MAP_SIZE || j >= MAP_SIZE || territoryBlocked[i][j])
+                continue;
+
+            if (territoryField[i][j] + 1 < territoryField[x][y])
+            {
+                territoryField[x][y] = territoryField[i][j] + 1;
+                territoryParents[x][y] = k;
+            }
+        }
+
+        if (territoryField[x][y] != territoryFar)
+            seeds.push_back(territoryField[x][y] * numOfCells + cell);
+    }
+
+    // The seeds and the queue are both in the order of the distances, the nearer front goes first
+    sort(seeds.begin(), seeds.end());
+
+    while (next < seeds.size() || head < queue.size())
+    {
+        int entry = head == queue.size() || (next < seeds.size() && seeds[next] < queue[head]) ? seeds[next++] : queue[head++];
+        int distance = entry / numOfCells;
+        int x = (entry % numOfCells) / MAP_SIZE;
+        int y = entry % MAP_SIZE;
+
+        if (territoryField[x][y] != distance)
+            continue;
+
+        for (int k = 0; k < 4; k++)
+        {
+            int i = x + dx[k];
+            int j = y + dy[k];
+
+            if (i < 0 || j < 0 || i >= MAP_SIZE || j >= MAP_SIZE || territoryBlocked[i][j] || territoryField[i][j] <= distance + 1)
+                continue;
+
+            territoryField[i][j] = distance + 1;
+            territoryParents[i][j] = k ^ 1;
+            queue.push_back((distance + 1) * numOfCells + i * MAP_SIZE + j);
+        }
+    }
+
+    nearestEnemyTerritory = territoryFar;
+
+    for (int i = 0; i < enemies.Size(); i++)
+        nearestEnemyTerritory = min(nearestEnemyTerritory, territoryField[enemies.x[i]][enemies.y[i]]);
+
+#ifdef ORACLE_VALIDATION
+    static int reference[MAP_SIZE][MAP_SIZE];
+    ReferenceMakeTerritory(territorySources, territoryBlocked, reference);
+    OracleCheck(playerView, !memcmp(reference, territoryField, sizeof(reference)), "UpdateTerritory");
+#endif
+}
+
+/*
+===================
+IsInBase
+===================
+*/
+bool IsInBase(const Vec2Int &position, int range = baseTerritoryRange)
+{
+    return territoryField[position.x][position.y] <= range;
+}
+
+/*
+===================
+StepToTerritory
+
+Steps down the territory field toward the nearest building of ours
+===================
+*/
+bool StepToTerritory(const Entity &entity, Vec2Int &move)
+{
+    const Vec2Int neighbours[] = { Vec2Int(entity.position.x + 1, entity.position.y), Vec2Int(entity.position.x, entity.position.y + 1), Vec2Int(entity.position.x - 1, entity.position.y), Vec2Int(entity.position.x, entity.position.y - 1) };
+    int value = territoryField[entity.position.x][entity.position.y];
+    int best = value;
+
+    if (value >= territoryFar)
+        return false;
+
+    for (const auto &neighbour : neighbours)
+    {
+        if (neighbour.x < 0 || neighbour.x >= MAP_SIZE || neighbour.y < 0 || neighbour.y >= MAP_SIZE)
+            continue;
+
+        if (territoryField[neighbour.x][neighbour.y] < best && IsPathCellFree(neighbour))
+        {
+            best = territoryField[neighbour.x][neighbour.y];
+            move = neighbour;
+        }
+    }
+
+    return best < value;
+}
+
+/*
+===================
+GetNearestBuilding
+
+Walls aren't worth retreating to
+===================
+*/
+bool GetNearestBuilding(const Vec2Int &from, Vec2Int &position)
+{
+    int nearestDistance = numeric_limits<int>::max();
+
+    for (const auto type : { HOUSE, BUILDER_BASE, MELEE_BASE, RANGED_BASE, TURRET })
+    {
+        const positionList_t &buildings = allyPositions[type];
+        int distance;
+        int nearest = GetNearestIndex(from, buildings, DISTANCE_SQUARED, &distance);
+
+        if (nearest != -1 && distance < nearestDistance)
+        {
+            nearestDistance = distance;
+            position = Vec2Int(buildings.x[nearest], buildings.y[nearest]);
+        }
+    }
+
+    return nearestDistance != numeric_limits<int>::max();
+}
+
+/*
+===================
+GetSpawnTile
+
+Free perimeter tile with the lowest value of the field, the first free one when nothing is reachable
+===================
+*/
+bool GetSpawnTile(const vector<Vec2Int> &tiles, const int (&field)[MAP_SIZE][MAP_SIZE], int unreachable, Vec2Int &spawn)
+{
+    int lowest = numeric_limits<int>::max();
+    bool found = false;
+
+    for (const auto &tile : tiles)
+    {
+        if (worldMap[tile.x][tile.y] != TILE_EMPTY)
+            continue;
+
+        int value = field[tile.x][tile.y] < unreachable ? field[tile.x][tile.y] : unreachable;
+
+        if (value < lowest)
+        {
+            lowest = value;
+            spawn = tile;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+/*
+===================
+PlanProduction
+
+Picks the unit and the spawn tile for every production building at once
+===================
+*/
+void PlanProduction(const PlayerView &playerView, int resources, int maxPopulation, float entitiesRatio)
+{
+    const EntityProperties &builder = playerView.entityProperties.at(BUILDER_UNIT);
+    const EntityProperties &melee = playerView.entityProperties.at(MELEE_UNIT);
+    // Every tile is empty here, the whole perimeter is cached once per building
+    static const tile_t openMap[MAP_SIZE][MAP_SIZE] = {};
+    int numOfBuilders = allyPositions[BUILDER_UNIT].Size();
+    int numOfTroops = allyPositions[MELEE_UNIT].Size() + allyPositions[RANGED_UNIT].Size();
+    int numOfTroopBases = allyPositions[MELEE_BASE].Size() + allyPositions[RANGED_BASE].Size();
+    bool troopsNeeded = (float)numOfTroops / (float)maxPopulation < entitiesRatio;
+    bool resourceFieldMade = false;
+    bool enemyFieldMade = false;
+    Vec2Int spawn;
+
+    productionPlans.clear();
+
+    for (const auto type : { BUILDER_BASE, MELEE_BASE, RANGED_BASE })
+    {
+        const positionList_t &buildings = allyPositions[type];
+        int sightRange = playerView.entityProperties.at(type).sightRange;
+        int size = playerView.entityProperties.at(type).size;
+
+        for (int n = 0; n < buildings.Size(); n++)
+        {
+            const Entity &building = playerView.entities[buildings.index[n]];
+            spawnTiles_t &perimeter = spawnTiles[building.id];
+
+            if (perimeter.tiles.empty())
+                GetSpawnPoints(playerView, building, openMap, perimeter.tiles);
+
+            perimeter.tick = playerView.currentTick;
+            // Enemies got into the base and they are near this building
+            Vec2Int center(building.position.x + size / 2, building.position.y + size / 2);
+            bool underAttack = nearestEnemyTerritory <= baseTerritoryRange + sightRange && AnyInRegion(center, baseTerritoryRange + sightRange + size, PLAYER_ENEMY);
+
+            if (type == BUILDER_BASE)
+            {
+                if (resources < builder.buildScore || underAttack || !numOfVisibleFrontier)
+                    continue;
+
+                if (numOfTroopBases && resources < melee.buildScore + builder.buildScore)
+                    continue;
+
+                if ((float)numOfBuilders / (float)maxPopulation >= 1.0f - entitiesRatio)
+                    continue;
+
+                if (!resourceFieldMade)
+                {
+                    MakeResourceField();
+                    resourceFieldMade = true;
+                }
+
+                if (GetSpawnTile(perimeter.tiles, resourceField, MAP_SIZE * MAP_SIZE, spawn) && resourceField[spawn.x][spawn.y] < MAP_SIZE * MAP_SIZE)
+                    productionPlans[building.id] = { BUILDER_UNIT, spawn };
+
+                continue;
+            }
+
+            // We don't need to build melee. We can win the game without them.
+            // They are spawned only before the first ranged base or when enemy troops are in our base.
+            if (type == MELEE_BASE && !(troopsNeeded && !allyPositions[RANGED_BASE].Size()) && !underAttack)
+                continue;
+
+            if (type == RANGED_BASE && !troopsNeeded && !underAttack)
+                continue;
+
+            if (!enemyFieldMade)
+            {
+                MakeEnemyField();
+                enemyFieldMade = true;
+            }
+
+            if (GetSpawnTile(perimeter.tiles, enemyField, MAP_SIZE * 2, spawn))
+                productionPlans[building.id] = { type == MELEE_BASE ? MELEE_UNIT : RANGED_UNIT, spawn };
+        }
+    }
+
+    for (auto it = spawnTiles.begin(); it != spawnTiles.end();)
+    {
+        if (it->second.tick != playerView.currentTick)
+            it = spawnTiles.erase(it);
+        else
+            it++;
+    }
+}
+
+/*
+===================
+GetProduction
+===================
+*/
+bool GetProduction(const Entity &building, EntityType &type, Vec2Int &spawn)
+{
+    auto it = productionPlans.find(building.id);
+
+    if (it == productionPlans.end())
+        return false;
+
+    type = it->second.type;
+    spawn = it->second.spawn;
+    return true;
+}
+
+/*
+===================
+StepToSafety
+
+Picks the free neighbour cell that is the farthest from the threats
+===================
+*/
+bool StepToSafety(const Entity &entity, Vec2Int &move)
+{
+    const Vec2Int neighbours[] = { Vec2Int(entity.position.x + 1, entity.position.y), Vec2Int(entity.position.x, entity.position.y + 1), Vec2Int(entity.position.x - 1, entity.position.y), Vec2Int(entity.position.x, entity.position.y - 1) };
+    int best = safetyMap[entity.position.x][entity.position.y];
+
+    for (const auto &neighbour : neighbours)
+    {
+        if (neighbour.x < 0 || neighbour.x >= MAP_SIZE || neighbour.y < 0 || neighbour.y >= MAP_SIZE)
+            continue;
+
+        if (moveMap(neighbour.x, neighbour.y) == PATH_EMPTY && !turretMask[neighbour.x][neighbour.y] && safetyMap[neighbour.x][neighbour.y] > best)
+        {
+            best = safetyMap[neighbour.x][neighbour.y];
+            move = neighbour;
+        }
+    }
+
+    return best > safetyMap[entity.position.x][entity.position.y];
+}
+
+/*
+===================
+MakeSquads
+
+Groups the ally troops into squads by linking the troops that are close to each other
+===================
+*/
+void MakeSquads(const PlayerView &playerView)
+{
+    static vector<int> parents;
+    static vector<int> distances;
+    static vector<int> groups;
+    int squaredRange = SquaredRange(squadLinkRange);
+    int count = allyTroops.Size();
+
+    for (int i = 0; i < MAP_SIZE; i++)
+        for (int j = 0; j < MAP_SIZE; j++)
+            squadMap[i][j] = -1;
+
+    numOfSquads = 0;
+    parents.resize(count);
+    distances.resize(count);
+    groups.assign(count, -1);
+
+    for (int i = 0; i < count; i++)
+        parents[i] = i;
+
+    auto root = [&](int i)
+    {
+        while (parents[i] != i)
+        {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+
+        return i;
+    };
+
+    for (int i = 0; i < count; i++)
+    {
+        GetDistances(Vec2Int(allyTroops.x[i], allyTroops.y[i]), allyTroops, DISTANCE_SQUARED, distances.data());
+
+        for (int j = i + 1; j < count; j++)
+            if (distances[j] <= squaredRange)
+                parents[root(j)] = root(i);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        int r = root(i);
+
+        if (groups[r] == -1)
+        {
+            int size = 0;
+
+            for (int j = i; j < count; j++)
+                if (root(j) == r)
+                    size++;
+
+            if (size < squadMinSize || numOfSquads == maxSquads)
+            {
+                groups[r] = -2;
+                continue;
+            }
+
+            squad_t &squad = squads[numOfSquads];
+            squad.members.clear();
+            squad.anchor = -1;
+            squad.worthToAttack = -1;
+            squad.fieldReady = false;
+            squad.hasTarget = false;
+            squad.enemies = enemyQuery_t();
+            groups[r] = numOfSquads++;
+        }
+
+        if (groups[r] < 0)
+            continue;
+
+        squads[groups[r]].members.push_back(allyTroops.index[i]);
+        squadMap[allyTroops.x[i]][allyTroops.y[i]] = groups[r];
+    }
+
+    // The anchor is the member nearest to the center of the squad
+    for (int s = 0; s < numOfSquads; s++)
+    {
+        squad_t &squad = squads[s];
+        int centerX = 0;
+        int centerY = 0;
+        int minDistance = numeric_limits<int>::max();
+
+        for (int index : squad.members)
+        {
+            centerX += playerView.entities[index].position.x;
+            centerY += playerView.entities[index].position.y;
+        }
+
+        centerX /= (int)squad.members.size();
+        centerY /= (int)squad.members.size();
+
+        for (int index : squad.members)
+        {
+            const Vec2Int &position = playerView.entities[index].position;
+            int distance = (position.x - centerX) * (position.x - centerX) + (position.y - centerY) * (position.y - centerY);
+
+            if (distance < minDistance)
+            {
+                minDistance = distance;
+                squad.anchor = index;
+            }
+        }
+    }
+}
+
+/*
+===================
+GetSquad
+===================
+*/
+squad_t *GetSquad(const Entity &entity)
+{
+    int squad = squadMap[entity.position.x][entity.position.y];
+    return squad == -1 ? nullptr : &squads[squad];
+}
+
+/*
+===================
+IsSquadWorthToAttack
+
+Evaluates IsItWorthToAttack once per squad from its anchor
+===================
+*/
+bool IsSquadWorthToAttack(const PlayerView &playerView, const Entity &entity, int allyRange, int enemyRange)
+{
+    squad_t *squad = GetSquad(entity);
+
+    if (!squad)
+        return IsItWorthToAttack(playerView, entity, allyRange, enemyRange);
+
+    if (squad->worthToAttack == -1)
+        squad->worthToAttack = IsItWorthToAttack(playerView, playerView.entities[squad->anchor], allyRange, enemyRange);
+
+    return squad->worthToAttack == 1;
+}
+
+/*
+===================
+MakeSquadField
+
+Picks the squad target and floods the distances to it until every member is reached
+===================
+*/
+void MakeSquadField(const PlayerView &playerView, squad_t &squad)
+{
+    static vector<Vec2Int> levels[9];
+    const Entity &anchor = playerView.entities[squad.anchor];
+    pathGrid_t &field = squad.field;
+    int targetId;
+    int remaining = (int)squad.members.size();
+    int total = 0;
+
+    squad.fieldReady = true;
+    squad.hasTarget = false;
+
+    if (SearchForEnemies(playerView, anchor, squad.enemies, squad.target, targetId, 99999, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT, BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE, WALL }))
+        squad.hasTarget = true;
+    else if (playerView.fogOfWar && !knownEnemies.empty())
+        squad.hasTarget = GetNearestPosition(anchor.position, knownEnemies, squad.target);
+    else if (playerView.fogOfWar && !knownEnemySpawns.empty())
+    {
+        squad.target = knownEnemySpawns[knownEnemySpawns.size() == 1 ? 0 : anchor.id % 2];
+        squad.hasTarget = true;
+    }
+
+    if (!squad.hasTarget)
+        return;
+
+    field = moveMap;
+
+    for (int i = 0; i < MAP_SIZE; i++)
+        if (turretMask[i].any())
+            for (int j = 0; j < MAP_SIZE; j++)
+                if (turretMask[i][j])
+                    field(i, j) = PATH_BLOCKED;
+
+    for (int index : squad.members)
+        field(playerView.entities[index].position.x, playerView.entities[index].position.y) = PATH_EMPTY;
+
+    for (auto &level : levels)
+        level.clear();
+
+    // Same costs as SearchPath, the levels are kept in a ring of buckets
+    field(squad.target.x, squad.target.y) = PATH_START;
+    levels[0].push_back(squad.target);
+
+    for (int path = 0, queued = 1; queued > 0 && remaining > 0 && path <= numeric_limits<int16_t>::max() - 8; path++)
+    {
+        vector<Vec2Int> &level = levels[path % 9];
+
+        for (size_t k = 0; k < level.size(); k++)
+        {
+            Vec2Int cell = level[k];
+            const Vec2Int neighbours[] = { Vec2Int(cell.x - 1, cell.y), Vec2Int(cell.x + 1, cell.y), Vec2Int(cell.x, cell.y - 1), Vec2Int(cell.x, cell.y + 1) };
+
+            if (squadMap[cell.x][cell.y] == (int)(&squad - squads))
+                remaining--;
+
+            for (const auto &neighbour : neighbours)
+            {
+                if (neighbour.x < 0 || neighbour.x >= MAP_SIZE || neighbour.y < 0 || neighbour.y >= MAP_SIZE)
+                    continue;
+
+                int16_t &value = field(neighbour.x, neighbour.y);
+
+                if (value == PATH_EMPTY)
+                {
+                    value = path + 1;
+                    levels[(path + 1) % 9].push_back(neighbour);
+                    queued++;
+                }
+                else if (value == PATH_DESTROYABLE)
+                {
+                    value = path + 8;
+                    levels[(path + 8) % 9].push_back(neighbour);
+                    queued++;
+                }
+            }
+        }
+
+        queued -= (int)level.size();
+        level.clear();
+    }
+
+    for (int index : squad.members)
+        total += max(0, (int)field(playerView.entities[index].position.x, playerView.entities[index].position.y));
+
+    squad.averageDistance = total / (int)squad.members.size();
+}
+
+/*
+===================
+FollowSquad
+
+Steps down the squad field, the members that got ahead of the squad wait for the rest
+===================
+*/
+bool FollowSquad(const PlayerView &playerView, const Entity &entity, Vec2Int &target, Vec2Int &move)
+{
+    squad_t *squad = GetSquad(entity);
+
+    if (!squad)
+        return false;
+
+    if (!squad->fieldReady)
+        MakeSquadField(playerView, *squad);
+
+    const pathGrid_t &field = squad->field;
+    int value = field(entity.position.x, entity.position.y);
+    int best = value;
+    bool bestIsFree = false;
+
+    if (!squad->hasTarget || value <= 0)
+        return false;
+
+    target = squad->target;
+    move = entity.position;
+
+    if (value < squad->averageDistance - squadMaxSpread)
+        return true;
+
+    // Prefers the cells that aren't taken by the other members
+    const Vec2Int neighbours[] = { Vec2Int(entity.position.x + 1, entity.position.y), Vec2Int(entity.position.x, entity.position.y + 1), Vec2Int(entity.position.x - 1, entity.position.y), Vec2Int(entity.position.x, entity.position.y - 1) };
+
+    for (const auto &neighbour : neighbours)
+    {
+        if (neighbour.x < 0 || neighbour.x >= MAP_SIZE || neighbour.y < 0 || neighbour.y >= MAP_SIZE)
+            continue;
+
+        int neighbourValue = field(neighbour.x, neighbour.y);
+        bool isFree = squadMap[neighbour.x][neighbour.y] == -1;
+
+        if (neighbourValue < PATH_START || neighbourValue >= value)
+            continue;
+
+        if (isFree > bestIsFree || (isFree == bestIsFree && neighbourValue < best))
+        {
+            best = neighbourValue;
+            bestIsFree = isFree;
+            move = neighbour;
+        }
+    }
+
+    return best < value;
+}
+
+/*
+===================
+StepDownField
+
+Moves to the free neighbour with the lowest label, the labels above the limit aren't trusted
+===================
+*/
+bool StepDownField(const pathGrid_t &field, const Entity &entity, int limit, Vec2Int &move)
+{
+    const Vec2Int neighbours[] = { Vec2Int(entity.position.x + 1, entity.position.y), Vec2Int(entity.position.x, entity.position.y + 1), Vec2Int(entity.position.x - 1, entity.position.y), Vec2Int(entity.position.x, entity.position.y - 1) };
+    int value = field(entity.position.x, entity.position.y);
+    int best = value;
+
+    if (value <= PATH_START || value > limit)
+        return false;
+
+    for (const auto &neighbour : neighbours)
+    {
+        if (neighbour.x < 0 || neighbour.x >= MAP_SIZE || neighbour.y < 0 || neighbour.y >= MAP_SIZE)
+            continue;
+
+        int neighbourValue = field(neighbour.x, neighbour.y);
+
+        if (neighbourValue >= PATH_START && neighbourValue < best && IsPathCellFree(neighbour))
+        {
+            best = neighbourValue;
+            move = neighbour;
+        }
+    }
+
+    return best < value;
+}
+
+/*
+===================
+MakeTerrainSource
+
+Path tiles of the terrain, the buildings and the enemy turret coverage
+===================
+*/
+void MakeTerrainSource(pathGrid_t &source)
+{
+    source.ForEach([](int i, int j, int16_t &cell)
+    {
+        if (turretMask[i][j] || terrainMap[i][j] == TILE_BLOCKED)
+            cell = PATH_BLOCKED;
+        else if (terrainMap[i][j] == TILE_DESTROYABLE)
+            cell = PATH_DESTROYABLE;
+        else
+            cell = PATH_EMPTY;
+    });
+}
+
+#ifdef BACKGROUND_PRECOMPUTE
+/*
+===================
+RunPrecompute
+
+Runs on the worker thread, it only touches its own buffer
+===================
+*/
+void RunPrecompute(precompute_t &buffer)
+{
+    vector<Vec2Int> positions;
+
+    buffer.fields.resize(buffer.spawns.size());
+    buffer.horizons.assign(buffer.spawns.size(), numeric_limits<int>::max());
+
+    for (size_t k = 0; k < buffer.spawns.size(); k++)
+    {
+        buffer.fields[k] = buffer.source;
+        buffer.fields[k](buffer.spawns[k].x, buffer.spawns[k].y) = PATH_START;
+        SearchPath(buffer.view, buffer.fields[k], positions);
+    }
+
+    buffer.houseFound = SearchPlaceForBuilding(buffer.view, nullptr, buffer.house, positions, HOUSE, 0, ALIGN_IN_CORNER, buffer.buildMap);
+}
+
+/*
+===================
+StartPrecompute
+===================
+*/
+void StartPrecompute(const PlayerView &playerView)
+{
+    precompute_t &buffer = precomputeBuffers[precomputed == &precomputeBuffers[0] ? 1 : 0];
+
+    if (precomputeWorker.joinable())
+        return;
+
+    // The player view is gone after the tick, so the worker gets a copy without the entities
+    buffer.view = PlayerView(playerView.myId, playerView.mapSize, playerView.fogOfWar, playerView.entityProperties, playerView.maxTickCount, playerView.maxPathfindNodes, playerView.currentTick, playerView.players, vector<Entity>());
+    buffer.spawns = knownEnemySpawns;
+    MakeTerrainSource(buffer.source);
+    memcpy(buffer.buildMap, buildMap, sizeof(buffer.buildMap));
+
+    precomputeWorker = thread(RunPrecompute, ref(buffer));
+}
+
+/*
+===================
+CollectPrecompute
+
+Takes the buffer of the worker and finds how far its fields are still exact, a changed tile can only change the labels above the labels around it
+===================
+*/
+void CollectPrecompute()
+{
+    static pathGrid_t source;
+
+    if (!precomputeWorker.joinable())
+        return;
+
+    precomputeWorker.join();
+    precomputed = &precomputeBuffers[precomputed == &precomputeBuffers[0] ? 1 : 0];
+    MakeTerrainSource(source);
+
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        for (int j = 0; j < MAP_SIZE; j++)
+        {
+            if (source(i, j) == precomputed->source(i, j))
+                continue;
+
+            for (size_t k = 0; k < precomputed->fields.size(); k++)
+            {
+                const pathGrid_t &field = precomputed->fields[k];
+                int &horizon = precomputed->horizons[k];
+
+                if (i > 0 && field(i - 1, j) >= PATH_START)               horizon = min(horizon, (int)field(i - 1, j));
+                if (i < MAP_SIZE - 1 && field(i + 1, j) >= PATH_START)    horizon = min(horizon, (int)field(i + 1, j));
+                if (j > 0 && field(i, j - 1) >= PATH_START)               horizon = min(horizon, (int)field(i, j - 1));
+                if (j < MAP_SIZE - 1 && field(i, j + 1) >= PATH_START)    horizon = min(horizon, (int)field(i, j + 1));
+            }
+        }
+    }
+}
+
+/*
+===================
+StepToSpawn
+
+Steps down the precomputed field of the spawn while the unit is below its horizon
+===================
+*/
+bool StepToSpawn(const Entity &entity, const Vec2Int &spawn, Vec2Int &move)
+{
+    if (!precomputed)
+        return false;
+
+    for (size_t k = 0; k < precomputed->spawns.size(); k++)
+    {
+        if (precomputed->spawns[k].x != spawn.x || precomputed->spawns[k].y != spawn.y)
+            continue;
+
+        return StepDownField(precomputed->fields[k], entity, precomputed->horizons[k], move);
+    }
+
+    return false;
+}
+#endif
+
+/*
+===================
+UpdateExploration
+
+Adds the visible cells to the explored ones, only the new cells change the frontier
+===================
+*/
+void UpdateExploration()
+{
+    static vector<Vec2Int> explored;
+    explored.clear();
+
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        bitset<MAP_SIZE> newCells = visibilityMask[i] & ~exploredMask[i];
+
+        if (newCells.none())
+            continue;
+
+        exploredMask[i] |= newCells;
+
+        for (int j = newCells._Find_first(); j < MAP_SIZE; j = newCells._Find_next(j))
+            explored.push_back(Vec2Int(i, j));
+    }
+
+    numOfExploredCells += (int)explored.size();
+
+    for (const auto &cell : explored)
+    {
+        const Vec2Int neighbours[] = { Vec2Int(cell.x + 1, cell.y), Vec2Int(cell.x, cell.y + 1), Vec2Int(cell.x - 1, cell.y), Vec2Int(cell.x, cell.y - 1) };
+
+        frontierMask[cell.x][cell.y] = false;
+
+        for (const auto &neighbour : neighbours)
+            if (neighbour.x >= 0 && neighbour.x < MAP_SIZE && neighbour.y >= 0 && neighbour.y < MAP_SIZE && !exploredMask[neighbour.x][neighbour.y])
+                frontierMask[neighbour.x][neighbour.y] = true;
+    }
+}
+
+/*
+===================
+MakeFrontierField
+
+Distances from every frontier cell at once, it's made only on the ticks some unit needs it
+===================
+*/
+void MakeFrontierField(const PlayerView &playerView)
+{
+    static vector<int> queue;
+    size_t head = 0;
+
+    MakeTerrainSource(frontierField);
+    queue.clear();
+
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        for (int j = frontierMask[i]._Find_first(); j < MAP_SIZE; j = frontierMask[i]._Find_next(j))
+        {
+            if (frontierField(i, j) == PATH_EMPTY)
+            {
+                frontierField(i, j) = PATH_START;
+                queue.push_back(i * MAP_SIZE + j);
+            }
+        }
+    }
+
+    while (head < queue.size())
+    {
+        int x = queue[head] / MAP_SIZE;
+        int y = queue[head] % MAP_SIZE;
+        int16_t next = frontierField(x, y) + 1;
+        head++;
+
+        auto visit = [&](int i, int j)
+        {
+            if (frontierField(i, j) == PATH_EMPTY)
+            {
+                frontierField(i, j) = next;
+                queue.push_back(i * MAP_SIZE + j);
+            }
+        };
+
+        if (x > 0)                  visit(x - 1, y);
+        if (x < MAP_SIZE - 1)       visit(x + 1, y);
+        if (y > 0)                  visit(x, y - 1);
+        if (y < MAP_SIZE - 1)       visit(x, y + 1);
+    }
+
+    frontierFieldTick = playerView.currentTick;
+}
+
+/*
+===================
+StepToFrontier
+
+Steps toward the nearest cell we haven't seen yet
+===================
+*/
+bool StepToFrontier(const PlayerView &playerView, const Entity &entity, Vec2Int &move)
+{
+    if (!playerView.fogOfWar)
+        return false;
+
+    if (frontierFieldTick != playerView.currentTick)
+        MakeFrontierField(playerView);
+
+    return StepDownField(frontierField, entity, numeric_limits<int>::max(), move);
+}
+
+/*
+===================
+IsIntentValid
+
+The intent of the last tick is still the result of the decisions when the unit hasn't moved and none of the conditions before it have changed
+===================
+*/
+bool IsIntentValid(const PlayerView &playerView, const Entity &entity)
+{
+    auto it = unitIntents.find(entity.id);
+
+    if (it == unitIntents.end())
+        return false;
+
+    const unitIntent_t &intent = it->second;
+
+    if (intent.intent != INTENT_GATHER || intent.tick != playerView.currentTick - 1)
+        return false;
+
+    if (intent.position.x != entity.position.x || intent.position.y != entity.position.y)
+        return false;
+
+    // The resource is still there and reachable, so the builder doesn't run away
+    if (resourceIds[intent.target.x][intent.target.y] != intent.targetId || !resourceFrontierMask[intent.target.x][intent.target.y])
+        return false;
+
+    // No enemies to attack nearby
+    if (AnyInRegion(entity.position, builderAttackBuilderDistance, PLAYER_ENEMY))
+        return false;
+
+    // Not sent to repair a building
+    if (repairAssignments.find(entity.id) != repairAssignments.end())
+        return false;
+
+    for (const auto &plan : buildPlans)
+        if (plan.builder == entity.id)
+            return false;
+
+    return true;
+}
+
+/*
+===================
+MakeMoveAction
+
+The Make*Action functions reuse the action objects of the last tick when the decision hasn't changed
+===================
+*/
+shared_ptr<MoveAction> MakeMoveAction(const EntityAction *lastAction, const Vec2Int &target, bool findClosestPosition, bool breakThrough)
+{
+    if (lastAction && lastAction->moveAction)
+    {
+        const MoveAction &last = *lastAction->moveAction;
+
+        if (last.target.x == target.x && last.target.y == target.y && last.findClosestPosition == findClosestPosition && last.breakThrough == breakThrough)
+            return lastAction->moveAction;
+    }
+
+    return shared_ptr<MoveAction>(new MoveAction(target, findClosestPosition, breakThrough));
+}
+
+/*
+===================
+MakeBuildAction
+===================
+*/
+shared_ptr<BuildAction> MakeBuildAction(const EntityAction *lastAction, EntityType entityType, const Vec2Int &position)
+{
+    if (lastAction && lastAction->buildAction)
+    {
+        const BuildAction &last = *lastAction->buildAction;
+
+        if (last.entityType == entityType && last.position.x == position.x && last.position.y == position.y)
+            return lastAction->buildAction;
+    }
+
+    return shared_ptr<BuildAction>(new BuildAction(entityType, position));
+}
+
+/*
+===================
+MakeAttackAction
+===================
+*/
+shared_ptr<AttackAction> MakeAttackAction(const EntityAction *lastAction, int targetId)
+{
+    if (lastAction && lastAction->attackAction)
+    {
+        const AttackAction &last = *lastAction->attackAction;
+
+        if (last.target && *last.target == targetId && !last.autoAttack)
+            return lastAction->attackAction;
+    }
+
+    return shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), nullptr));
+}
+
+shared_ptr<AttackAction> MakeAttackAction(const EntityAction *lastAction, int targetId, int pathfindRange, const vector<EntityType> &validTargets)
+{
+    if (lastAction && lastAction->attackAction)
+    {
+        const AttackAction &last = *lastAction->attackAction;
+
+        if (last.target && *last.target == targetId && last.autoAttack && last.autoAttack->pathfindRange == pathfindRange && last.autoAttack->validTargets == validTargets)
+            return lastAction->attackAction;
+    }
+
+    return shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), shared_ptr<AutoAttack>(new AutoAttack(pathfindRange, validTargets))));
+}
+
+/*
+===================
+MakeRepairAction
+===================
+*/
+shared_ptr<RepairAction> MakeRepairAction(const EntityAction *lastAction, int targetId)
+{
+    if (lastAction && lastAction->repairAction && lastAction->repairAction->target == targetId)
+        return lastAction->repairAction;
+
+    return shared_ptr<RepairAction>(new RepairAction(targetId));
+}
+
+/*
+===================
+IsSameEntityAction
+
+Reused actions are the same objects, so comparing pointers is enough
+===================
+*/
+bool IsSameEntityAction(const EntityAction &action1, const EntityAction &action2)
+{
+    return action1.moveAction == action2.moveAction && action1.buildAction == action2.buildAction && action1.attackAction == action2.attackAction && action1.repairAction == action2.repairAction;
+}
+
+#if defined(SLOW_TICK_WATCHDOG) || defined(STRATEGY_TOOLS)
+/*
+===================
+WriteTickState
+
+The state of the strategy that the next tick starts from, the caches are left out and rebuilt on replay
+===================
+*/
+void WriteTickState(OutputStream &stream)
+{
+    auto writePositions = [&](const vector<Vec2Int> &positions)
+    {
+        stream.write((int)positions.size());
+
+        for (const auto &position : positions)
+            position.writeTo(stream);
+    };
+
+    stream.write(currentTick);
+    writePositions(knownEnemies);
+    writePositions(knownEnemySpawns);
+    stream.writeBytes((const char *)unitPositionsAtLastTick, sizeof(unitPositionsAtLastTick));
+    stream.writeBytes((const char *)unitPositionsAtCurrentTick, sizeof(unitPositionsAtCurrentTick));
+    stream.writeBytes((const char *)worldMap, sizeof(worldMap));
+    stream.writeBytes((const char *)buildMap, sizeof(buildMap));
+    stream.writeBytes((const char *)terrainMap, sizeof(terrainMap));
+    stream.writeBytes((const char *)exploredMask, sizeof(exploredMask));
+    stream.writeBytes((const char *)frontierMask, sizeof(frontierMask));
+    stream.write(numOfExploredCells);
+
+    stream.write((int)unitPaths.size());
+
+    for (const auto &unitPath : unitPaths)
+    {
+        stream.write(unitPath.first);
+        unitPath.second.target.writeTo(stream);
+        stream.write(unitPath.second.tick);
+        writePositions(unitPath.second.cells);
+    }
+
+    stream.write((int)unitIntents.size());
+
+    for (const auto &unitIntent : unitIntents)
+    {
+        stream.write(unitIntent.first);
+        stream.writeBytes((const char *)&unitIntent.second, sizeof(unitIntent.second));
+    }
+
+    writePositions(openingLayout);
+    stream.writeBytes((const char *)resourceClusters, sizeof(resourceClusters));
+    stream.writeBytes((const char *)resourceNodeMask, sizeof(resourceNodeMask));
+    stream.writeBytes((const char *)resourceMask, sizeof(resourceMask));
+    stream.writeBytes((const char *)resourceFrontierMask, sizeof(resourceFrontierMask));
+    stream.write(numOfResourceCells);
+    stream.write(numOfRemovedResources);
+
+    stream.write((int)spawnTiles.size());
+
+    for (const auto &perimeter : spawnTiles)
+    {
+        stream.write(perimeter.first);
+        stream.write(perimeter.second.tick);
+        writePositions(perimeter.second.tiles);
+    }
+
+    stream.write((int)lastActions.size());
+
+    for (const auto &lastAction : lastActions)
+    {
+        stream.write(lastAction.first);
+        lastAction.second.writeTo(stream);
+    }
+}
+
+/*
+===================
+ReadTickState
+
+The incremental caches are rebuilt from scratch, they come out the same as the ones the game had built tick by tick
+===================
+*/
+void ReadTickState(InputStream &stream)
+{
+    auto readPositions = [&](vector<Vec2Int> &positions)
+    {
+        positions.resize(stream.readInt());
+
+        for (auto &position : positions)
+            position = Vec2Int::readFrom(stream);
+    };
+
+    currentTick = stream.readInt();
+    readPositions(knownEnemies);
+    readPositions(knownEnemySpawns);
+    stream.readBytes((char *)unitPositionsAtLastTick, sizeof(unitPositionsAtLastTick));
+    stream.readBytes((char *)unitPositionsAtCurrentTick, sizeof(unitPositionsAtCurrentTick));
+    stream.readBytes((char *)worldMap, sizeof(worldMap));
+    stream.readBytes((char *)buildMap, sizeof(buildMap));
+    stream.readBytes((char *)terrainMap, sizeof(terrainMap));
+    stream.readBytes((char *)exploredMask, sizeof(exploredMask));
+    stream.readBytes((char *)frontierMask, sizeof(frontierMask));
+    numOfExploredCells = stream.readInt();
+
+    unitPaths.clear();
+
+    for (int i = stream.readInt(); i > 0; i--)
+    {
+        unitPath_t &unitPath = unitPaths[stream.readInt()];
+        unitPath.target = Vec2Int::readFrom(stream);
+        unitPath.tick = stream.readInt();
+        readPositions(unitPath.cells);
+    }
+
+    unitIntents.clear();
+
+    for (int i = stream.readInt(); i > 0; i--)
+    {
+        unitIntent_t &unitIntent = unitIntents[stream.readInt()];
+        stream.readBytes((char *)&unitIntent, sizeof(unitIntent));
+    }
+
+    readPositions(openingLayout);
+    stream.readBytes((char *)resourceClusters, sizeof(resourceClusters));
+    stream.readBytes((char *)resourceNodeMask, sizeof(resourceNodeMask));
+    stream.readBytes((char *)resourceMask, sizeof(resourceMask));
+    stream.readBytes((char *)resourceFrontierMask, sizeof(resourceFrontierMask));
+    numOfResourceCells = stream.readInt();
+    numOfRemovedResources = stream.readInt();
+
+    spawnTiles.clear();
 
-        if (lowestHealth == numeric_limits<int>::max() && enemyDistance < MinDistance && enemyDistance <= range)
-        {
-            MinDistance = enemyDistance;
-            position.x = enemy.position.x;
-            position.y = enemy.position.y;
-            targetId = enemy.id;
-            found = true;
-        }
+    for (int i = stream.readInt(); i > 0; i--)
+    {
+        spawnTiles_t &perimeter = spawnTiles[stream.readInt()];
+        perimeter.tick = stream.readInt();
+        readPositions(perimeter.tiles);
     }
 
-    return found;
+    lastActions.clear();
+
+    for (int i = stream.readInt(); i > 0; i--)
+    {
+        int id = stream.readInt();
+        lastActions[id] = EntityAction::readFrom(stream);
+    }
+
+    // A second run in the same process would start from the caches of the first one
+    jumpTablesValid = false;
+    territoryValid = false;
+    frontierFieldTick = -1;
 }
 
 /*
 ===================
-GetNearestEnemyPosition
+MemoryOutputStream
 ===================
 */
-bool GetNearestEnemyPosition(const PlayerView &playerView, Vec2Int &position, const Vec2Int fromPosition = Vec2Int(0, 0))
+class MemoryOutputStream : public OutputStream
 {
-    bool found = false;
-    float nearestDistance = numeric_limits<float>::max();
+public:
+    void writeBytes(const char *buffer, size_t byteCount) override { data.insert(data.end(), buffer, buffer + byteCount); }
+    void flush() override {}
 
-    for (const auto &entity : playerView.entities)
-    {
-        if (entity.playerId && *entity.playerId != playerView.myId && (entity.entityType == MELEE_UNIT || entity.entityType == RANGED_UNIT))
-        {
-            float distance = Distance(fromPosition, entity.position);
-            if (distance < nearestDistance)
-            {
-                nearestDistance = distance;
-                position.x = entity.position.x;
-                position.y = entity.position.y;
-                found = true;
-            }
-        }
-    }
+    vector<char> data;
+};
+#endif
 
-    return found;
-}
+#ifdef SLOW_TICK_WATCHDOG
+// The state is saved at the start of every tick, it's written out only when the tick turns out slow
+MemoryOutputStream tickStartState;
+int numOfSlowTickDumps;
 
 /*
 ===================
-IsItWorthToAttack
+DumpSlowTick
 ===================
 */
-bool IsItWorthToAttack(const PlayerView &playerView, const Entity &fromEntity, int allyRange, int enemyRange)
+void DumpSlowTick(const PlayerView &playerView, double tickMs)
 {
-    int allyScore = 0;
-    int enemyScore = 0;
-    vector<int> counted;
-
-    for (const auto &enemy : playerView.entities)
-    {
-        if (enemy.playerId && *enemy.playerId != playerView.myId && (enemy.entityType == MELEE_UNIT || enemy.entityType == RANGED_UNIT))
-        {
-            if (fromEntity.entityType == RANGED_UNIT && enemy.entityType == RANGED_UNIT && IsAtRange(playerView, fromEntity, enemy.position, ranged_dontRunAwayFromRanged)) return true;
-            if (fromEntity.entityType == RANGED_UNIT && enemy.entityType == MELEE_UNIT && IsAtRange(playerView, fromEntity, enemy.position, ranged_dontRunAwayFromMelee)) return true;
-            if (fromEntity.entityType == MELEE_UNIT && enemy.entityType == RANGED_UNIT && IsAtRange(playerView, fromEntity, enemy.position, melee_dontRunAwayFromRanged)) return true;
-            if (fromEntity.entityType == MELEE_UNIT && enemy.entityType == MELEE_UNIT && IsAtRange(playerView, fromEntity, enemy.position, melee_dontRunAwayFromMelee)) return true;
+    char fileName[64];
+    MemoryOutputStream stream;
 
-            if (IsAtRange(playerView, fromEntity, enemy.position, allyRange))
-            {
-                if (enemy.entityType == MELEE_UNIT) enemyScore += (int)(enemy.health * enemyMeleeRunAwayMultiplier);
-                else if (enemy.entityType == RANGED_UNIT) enemyScore += (int)(enemy.health * enemyRangedRunAwayMultiplier);
-
-                for (const auto &ally : playerView.entities)
-                {
-                    if (ally.playerId && *ally.playerId == playerView.myId && (ally.entityType == MELEE_UNIT || ally.entityType == RANGED_UNIT))
-                    {
-                        if (IsAtRange(playerView, enemy, ally.position, enemyRange))
-                        {
-                            if (Distance(Vec2Int(0, 0), enemy.position) < Distance(Vec2Int(0, 0), ally.position))
-                                return true;
+    snprintf(fileName, sizeof(fileName), "slow_tick_%d.bin", playerView.currentTick);
+    stream.write(slowTickFileVersion);
+    stream.write(tickMs);
+    playerView.writeTo(stream);
+    stream.writeBytes(tickStartState.data.data(), tickStartState.data.size());
 
-                            if (find(counted.begin(), counted.end(), ally.id) == counted.end())
-                            {
-                                counted.push_back(ally.id);
+    FILE *file = fopen(fileName, "wb");
 
-                                if (ally.entityType == MELEE_UNIT) allyScore += (int)(ally.health * allyMeleeRunAwayMultiplier);
-                                else if (ally.entityType == RANGED_UNIT) allyScore += (int)(ally.health * allyRangedRunAwayMultiplier);
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
+    if (!file)
+        return;
 
-    if (allyScore >= enemyScore)
-        return true;
-    else
-        return false;
+    fwrite(stream.data.data(), 1, stream.data.size(), file);
+    fclose(file);
+    numOfSlowTickDumps++;
 }
+#endif
+
+#ifdef GAME_TELEMETRY
+FILE *telemetryFile;
+bool telemetryFileFailed;
+// Resources, ally ids and numbers of the ally entities by the type of the last tick, -1 before the first one
+int telemetryResources = -1;
+vector<int> telemetryAllyIds;
+int telemetryCounts[NUM_ENTITY_TYPES];
 
 /*
 ===================
-Move
+WriteTelemetry
+
+The gained resources are counted back from the spending. A new unit is paid at its initial cost plus the number of its type we had on the last tick, every one bought in the same tick costs one more
 ===================
 */
-bool Move(const PlayerView &playerView, const Entity &entity, const Vec2Int &target, Vec2Int &move)
+void WriteTelemetry(const PlayerView &playerView, double tickMs, int resources, int population, int maxPopulation, int numOfBuilders)
 {
-    int path[MAP_SIZE][MAP_SIZE];
-    const EntityProperties &properties = playerView.entityProperties.at(entity.entityType);
-    vector<Vec2Int> positions;
+    vector<int> allyIds;
+    int counts[NUM_ENTITY_TYPES] = {};
+    int spent = 0;
 
-    for (int i = 0; i < MAP_SIZE; i++)
+    if (telemetryFileFailed)
+        return;
+
+    if (!telemetryFile)
     {
-        for (int j = 0; j < MAP_SIZE; j++)
+        telemetryFile = fopen(telemetryFileName, "w");
+
+        if (!telemetryFile)
         {
-            if (worldMap[i][j] == TILE_EMPTY)
-                path[i][j] = PATH_EMPTY;
-            else if (worldMap[i][j] == TILE_DESTROYABLE)
-                path[i][j] = PATH_DESTROYABLE;
-            else
-                path[i][j] = PATH_BLOCKED;
+            telemetryFileFailed = true;
+            return;
         }
+
+        fprintf(telemetryFile, "tick,ms,resources,gained,population,maxPopulation,builders,idleBuilders,blockedBuilders,failedMoves,replans,searchCells\n");
     }
 
     for (const auto &entity : playerView.entities)
     {
-        const EntityProperties &property = playerView.entityProperties.at(entity.entityType);
-
-        if (entity.entityType == RESOURCE) continue;
-
-        if (entity.playerId && *entity.playerId == playerView.myId && (entity.entityType == RANGED_UNIT || entity.entityType == MELEE_UNIT || entity.entityType == BUILDER_UNIT))
-        {
-            if (unitPositionsAtLastTick[entity.position.x][entity.position.y] != unitPositionsAtCurrentTick[entity.position.x][entity.position.y])
-                path[entity.position.x][entity.position.y] = PATH_EMPTY;
-            else
-                path[entity.position.x][entity.position.y] = PATH_BLOCKED;
-        }
-        else
-        {
-            for (int i = 0; i < property.size; i++)
-                for (int j = 0; j < property.size; j++)
-                    path[entity.position.x + i][entity.position.y + j] = PATH_BLOCKED;
-        }
-    }
+        if (!entity.playerId || *entity.playerId != playerView.myId)
+            continue;
 
-    for (int i = 0; i < properties.size; i++)
-        for (int j = 0; j < properties.size; j++)
-            path[entity.position.x + i][entity.position.y + j] = PATH_TARGET;
+        allyIds.push_back(entity.id);
+        counts[entity.entityType]++;
 
-    path[target.x][target.y] = PATH_START;
-  
-    // Makes ally troops avoid enemy turrets
-    for (const auto &turret : playerView.entities)
-    {
-        if (turret.playerId && *turret.playerId != playerView.myId && turret.entityType == TURRET)
+        if (telemetryResources >= 0 && !binary_search(telemetryAllyIds.begin(), telemetryAllyIds.end(), entity.id))
         {
-            int entitySize = playerView.entityProperties.at(turret.entityType).size;
-            int range = playerView.entityProperties.at(turret.entityType).attack->attackRange;
+            const EntityProperties &properties = playerView.entityProperties.at(entity.entityType);
 
-            for (int i = 0; i < entitySize; i++)
-            {
-                for (int j = 0; j < entitySize; j++)
-                {
-                    for (int x = 0; x <= range; x++)
-                        for (int y = 0; y <= range - x; y++)
-                            if (turret.position.x + i + x < MAP_SIZE && turret.position.y + j + y < MAP_SIZE)
-                                path[turret.position.x + i + x][turret.position.y + j + y] = PATH_BLOCKED;
-
-                    for (int x = -range; x <= 0; x++)
-                        for (int y = 0; y <= range + x; y++)
-                            if (turret.position.x + i + x >= 0 && turret.position.y + j + y < MAP_SIZE)
-                                path[turret.position.x + i + x][turret.position.y + j + y] = PATH_BLOCKED;
-
-                    for (int x = 0; x <= range; x++)
-                        for (int y = 0; y >= -range + x; y--)
-                            if (turret.position.x + i + x < MAP_SIZE && turret.position.y + j + y >= 0)
-                                path[turret.position.x + i + x][turret.position.y + j + y] = PATH_BLOCKED;
-
-                    for (int x = -range; x <= 0; x++)
-                        for (int y = 0; y >= -range - x; y--)
-                            if (turret.position.x + i + x >= 0 && turret.position.y + j + y >= 0)
-                                path[turret.position.x + i + x][turret.position.y + j + y] = PATH_BLOCKED;
-                }
-            }
+            // Only the units get dearer, the buildings always cost the same
+            spent += properties.initialCost + (properties.canMove ? telemetryCounts[entity.entityType]++ : 0);
         }
     }
 
-    // Calculates the next move position
-    if (SearchPath(playerView, path, positions))
-    {
-        if (entity.position.x + 1 < MAP_SIZE && path[entity.position.x + 1][entity.position.y] == path[entity.position.x][entity.position.y] - 1)
-        {
-            move.x = entity.position.x + 1;
-            move.y = entity.position.y;
-        }
-        else if (entity.position.y + 1 < MAP_SIZE && path[entity.position.x][entity.position.y + 1] == path[entity.position.x][entity.position.y] - 1)
-        {
-            move.x = entity.position.x;
-            move.y = entity.position.y + 1;
-        }
-        else if (entity.position.x - 1 >= 0 && path[entity.position.x - 1][entity.position.y] == path[entity.position.x][entity.position.y] - 1)
-        {
-            move.x = entity.position.x - 1;
-            move.y = entity.position.y;
-        }
-        else if (entity.position.y - 1 >= 0 && path[entity.position.x][entity.position.y - 1] == path[entity.position.x][entity.position.y] - 1)
-        {
-            move.x = entity.position.x;
-            move.y = entity.position.y - 1;
-        }
+    sort(allyIds.begin(), allyIds.end());
+    int gained = telemetryResources >= 0 ? resources - telemetryResources + spent : 0;
 
-        return true;
-    }
+    fprintf(telemetryFile, "%d,%.3f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%lld\n", playerView.currentTick, tickMs, resources, gained, population, maxPopulation, numOfBuilders,
+        telemetry.idleBuilders, telemetry.blockedBuilders, telemetry.failedMoves, telemetry.replans, searchCellsExpanded);
 
-    return false;
+    if (playerView.currentTick % telemetryFlushTicks == 0)
+        fflush(telemetryFile);
+
+    telemetryResources = resources;
+    telemetryAllyIds.swap(allyIds);
+    memcpy(telemetryCounts, counts, sizeof(telemetryCounts));
 }
+#endif
 
 /*
 ===================
@@ -871,30 +5011,33 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
     int numOfMeleeBases = 0;
     int numOfRangedBases = 0;
     int numOfHouses = 0;
-    int numOfResources = 0;
     int numOfTurrets = 0;
     int baseSize = 0;
-    int farthestBuilder = 0;
     int targetId = 0;
     float entitiesRatio = 0.0f;
     Vec2Int spawnPoint;
     Vec2Int targetPosition;
     Vec2Int positionForBuilding;
     Vec2Int movePosition;
+    Vec2Int reachableTarget;
     vector<Vec2Int> positionsForBuilding;
-    const Entity *targetEntity = nullptr;
-    const EntityProperties &builder = playerView.entityProperties.at(BUILDER_UNIT);
-    const EntityProperties &melee = playerView.entityProperties.at(MELEE_UNIT);
     const EntityProperties &ranged = playerView.entityProperties.at(RANGED_UNIT);
-    const EntityProperties &builderBase = playerView.entityProperties.at(BUILDER_BASE);
-    const EntityProperties &meleeBase = playerView.entityProperties.at(MELEE_BASE);
-    const EntityProperties &rangedBase = playerView.entityProperties.at(RANGED_BASE);
     const EntityProperties &house = playerView.entityProperties.at(HOUSE);
     const EntityProperties &turret = playerView.entityProperties.at(TURRET);
     const unordered_map<EntityType, EntityProperties> &entityProperties = playerView.entityProperties;
     const vector<Entity> &entities = playerView.entities;
 
-    static int currentTick = 0;
+#ifdef SLOW_TICK_WATCHDOG
+    tickStartState.data.clear();
+    WriteTickState(tickStartState);
+    auto tickStart = chrono::steady_clock::now();
+#endif
+
+#ifdef GAME_TELEMETRY
+    telemetry = telemetry_t();
+    searchCellsExpanded = 0;
+    auto telemetryStart = chrono::steady_clock::now();
+#endif
 
     if (playerView.currentTick == currentTick)
     {
@@ -919,14 +5062,57 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
             knownEnemySpawns.push_back(Vec2Int(MAP_SIZE - 1, MAP_SIZE - 1));
         }
 
+        if (playerView.fogOfWar)
+        {
+            MakeVisibilityMask(playerView);
+            UpdateExploration();
+
+            for (int i = 0; i < MAP_SIZE; i++)
+                enemyPositions[i].reset();
+
+            for (const auto &entity : playerView.entities)
+                if (entity.playerId && *entity.playerId != myId)
+                    enemyPositions[entity.position.x][entity.position.y] = true;
+
+            // Removes the known enemy positions if they are not in the fog of war
+            for (auto it = knownEnemies.begin(); it != knownEnemies.end();)
+            {
+                if (visibilityMask[it->x][it->y] && !enemyPositions[it->x][it->y])
+                    it = knownEnemies.erase(it);
+                else
+                    it++;
+            }
+
+            // Removes the known enemy spawns if they are not in the fog of war
+            for (auto it = knownEnemySpawns.begin(); it != knownEnemySpawns.end();)
+            {
+                if (visibilityMask[it->x][it->y])
+                    it = knownEnemySpawns.erase(it);
+                else
+                    it++;
+            }
+        }
+
         MakeMap(playerView, worldMap);
         MakeMap(playerView, buildMap, true);
+        MakeMap(playerView, terrainMap, false, false);
+        UpdateResourceIndex(playerView);
 
-        for (const auto &entity : playerView.entities)
+        if (!currentTick)
+            MakeOpeningLayout(playerView);
+
+        for (int type = 0; type < NUM_ENTITY_TYPES; type++)
+            allyPositions[type].Clear();
+
+        allyTroops.Clear();
+        enemies.Clear();
+        damagedBuildings.Clear();
+
+        for (int index = 0; index < (int)playerView.entities.size(); index++)
         {
+            const Entity &entity = playerView.entities[index];
             const EntityProperties &properties = playerView.entityProperties.at(entity.entityType);
 
-            if (entity.entityType == RESOURCE) numOfResources++;
             if (!entity.playerId) continue;
 
             if (*entity.playerId == myId)
@@ -934,50 +5120,8 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
                 if (entity.entityType == BUILDER_UNIT || entity.entityType == MELEE_UNIT || entity.entityType == RANGED_UNIT)
                     unitPositionsAtCurrentTick[entity.position.x][entity.position.y] = entity.id;
 
-                if (playerView.fogOfWar)
-                {
-                    // Removes the known enemy positions if they are not in the fog of war
-                    for (auto it = knownEnemies.begin(); it != knownEnemies.end();)
-                    {
-                        if (IsAtRange(playerView, entity, *it, properties.sightRange))
-                        {
-                            bool exists = false;
-
-                            for (const auto &enemy : playerView.entities)
-                                if (enemy.playerId && *enemy.playerId != myId && enemy.position.x == it->x && enemy.position.y == it->y)
-                                    exists = true;
-
-                            if (!exists)
-                            {
-                                it = knownEnemies.erase(it);
-                                continue;
-                            }
-                        }
-
-                        it++;
-                    }
-
-                    // Removes the known enemy spawns if they are not in the fog of war
-                    for (auto it = knownEnemySpawns.begin(); it != knownEnemySpawns.end();)
-                    {
-                        if (Distance(entity.position, *it) <= properties.sightRange)
-                            it = knownEnemySpawns.erase(it);
-                        else
-                            it++;
-                    }
-                }
-
-                // Calculate base size and the farthest builder
-                if ((entity.entityType == BUILDER_BASE || entity.entityType == MELEE_BASE || entity.entityType == RANGED_BASE || entity.entityType == HOUSE))
-                {
-                    float distance = Distance(Vec2Int(0, 0), Vec2Int(entity.position.x, entity.position.y));
-                    if (distance > baseSize) baseSize = (int)distance;
-                }
-                else if (entity.entityType == BUILDER_UNIT)
-                {
-                    float distance = Distance(Vec2Int(0, 0), entity.position);
-                    if (distance > farthestBuilder) farthestBuilder = (int)distance;
-                }
+                allyPositions[entity.entityType].Add(entity.position, index);
+                if (entity.entityType == MELEE_UNIT || entity.entityType == RANGED_UNIT) allyTroops.Add(entity.position, index);
 
                 population += properties.populationUse;
                 maxPopulation += properties.populationProvide;
@@ -991,9 +5135,17 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
                 if (entity.entityType == RANGED_BASE) numOfRangedBases++;
                 if (entity.entityType == HOUSE) numOfHouses++;
                 if (entity.entityType == TURRET) numOfTurrets++;
+
+                if ((entity.entityType == BUILDER_BASE || entity.entityType == MELEE_BASE || entity.entityType == RANGED_BASE || entity.entityType == HOUSE || entity.entityType == TURRET) && entity.health < properties.maxHealth)
+                    damagedBuildings.Add(entity.position, index);
+            }
+            else
+            {
+                enemies.Add(entity.position, index);
             }
+
             // Saves the last known enemy positions
-            else if (playerView.fogOfWar)
+            if (*entity.playerId != myId && playerView.fogOfWar)
             {
                 bool exists = false;
 
@@ -1005,11 +5157,63 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
             }
         }
 
+        MakeSectorPyramid(playerView);
+        MakeMoveMap(playerView);
+        UpdateJumpTables();
+        MakeReachLabels();
+        UpdateTerritory(playerView);
+        MakeSquads(playerView);
+
+#ifdef BACKGROUND_PRECOMPUTE
+        CollectPrecompute();
+#endif
+        MakeSafetyMap(playerView);
+        AllocateFocusFire(playerView);
+        DispatchRepairs(playerView, !numOfRangedBases);
+
+        for (auto it = unitPaths.begin(); it != unitPaths.end();)
+        {
+            if (playerView.currentTick - it->second.tick > pathMaxAge)
+                it = unitPaths.erase(it);
+            else
+                it++;
+        }
+
+        for (auto it = unitIntents.begin(); it != unitIntents.end();)
+        {
+            if (playerView.currentTick - it->second.tick > 1)
+                it = unitIntents.erase(it);
+            else
+                it++;
+        }
+
+        // Calculate base size
+        baseSize = max(max(GetFarthestDistance(Vec2Int(0, 0), allyPositions[BUILDER_BASE]), GetFarthestDistance(Vec2Int(0, 0), allyPositions[MELEE_BASE])), max(GetFarthestDistance(Vec2Int(0, 0), allyPositions[RANGED_BASE]), GetFarthestDistance(Vec2Int(0, 0), allyPositions[HOUSE])));
+
         if (numOfMeleeBases || numOfRangedBases) entitiesRatio = troopsBuildersRatio;
 
+        // Plans the buildings of the tick, the resources of each plan are reserved for it
+        int plannedResources = resources;
+
+        for (auto &plan : buildPlans)
+            plan.builder = -1;
+
+        if (!numOfBuilderBases)
+            PlanBuilding(playerView, BUILDER_BASE, plannedResources);
+
+        if (!numOfRangedBases)
+            PlanBuilding(playerView, RANGED_BASE, plannedResources, baseSize);
+
+        if (plannedResources >= house.buildScore * (numOfHouses + 1) && population >= maxPopulation - house.populationProvide)
+            PlanBuilding(playerView, HOUSE, plannedResources);
+
+        PlanProduction(playerView, resources, maxPopulation, entitiesRatio);
+
         currentTick++;
     }
 
+    unordered_map<int, EntityAction> currentActions;
+
     // Main logic
     for (const auto &entity : playerView.entities)
     {
@@ -1020,62 +5224,21 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
         shared_ptr<BuildAction> buildAction = nullptr;
         shared_ptr<AttackAction> attackAction = nullptr;
         shared_ptr<RepairAction> repairAction = nullptr;
+        enemyQuery_t enemies;
+        auto lastActionIt = lastActions.find(entity.id);
+        const EntityAction *lastAction = lastActionIt != lastActions.end() ? &lastActionIt->second : nullptr;
 
         /*
         ===================================================================================================
-            BUILDER BASE
-        ===================================================================================================
-        */
-        if (entity.entityType == BUILDER_BASE && resources >= builder.buildScore)
-        {
-            if (!SearchForEnemies(playerView, entity, targetPosition, targetId, baseSize + builderBase.sightRange) && ((!numOfMeleeBases && !numOfRangedBases) || resources >= melee.buildScore + builder.buildScore) && ((float)((float)numOfBuilders / (float)maxPopulation) < 1.0f - entitiesRatio))
-                if (SearchForResources(playerView, entity, targetPosition, targetId))
-                    if (GetNearestSpawnPoint(playerView, entity, targetPosition, spawnPoint))
-                        buildAction = shared_ptr<BuildAction>(new BuildAction(BUILDER_UNIT, spawnPoint));
-        }
-        /*
-        ===================================================================================================
-            MELEE BASE
-
-            We don't need to build melee. We can win the game without them.
-        ===================================================================================================
-        */
-        else if (entity.entityType == MELEE_BASE)
-        {
-            if (!numOfRangedBases && (((float)((float)numOfTroops / (float)maxPopulation) < entitiesRatio)))
-            {
-                if (SearchForEnemies(playerView, entity, targetPosition, targetId, mapSize) && GetNearestSpawnPoint(playerView, entity, targetPosition, spawnPoint)) {}
-                else if (!knownEnemies.empty() && GetNearestPosition(entity.position, knownEnemies, targetPosition) && GetNearestSpawnPoint(playerView, entity, targetPosition, spawnPoint)) {}
-                else if (!knownEnemySpawns.empty() && GetNearestPosition(entity.position, knownEnemySpawns, targetPosition) && GetNearestSpawnPoint(playerView, entity, targetPosition, spawnPoint)) {}
-
-                buildAction = shared_ptr<BuildAction>(new BuildAction(MELEE_UNIT, spawnPoint));
-            }
-
-            // Spawn melee units when enemy troops are in our base.
-            if (/*!numOfRangedBases && */SearchForEnemies(playerView, entity, targetPosition, targetId, baseSize + meleeBase.sightRange))
-                if (GetNearestSpawnPoint(playerView, entity, targetPosition, spawnPoint))
-                    buildAction = shared_ptr<BuildAction>(new BuildAction(MELEE_UNIT, spawnPoint));
-        }
-        /*
-        ===================================================================================================
-            RANGED BASE
+            PRODUCTION BUILDINGS
         ===================================================================================================
         */
-        else if (entity.entityType == RANGED_BASE)
+        if (entity.entityType == BUILDER_BASE || entity.entityType == MELEE_BASE || entity.entityType == RANGED_BASE)
         {
-            if ((((float)((float)numOfTroops / (float)maxPopulation) < entitiesRatio)))
-            {
-                if (SearchForEnemies(playerView, entity, targetPosition, targetId, mapSize) && GetNearestSpawnPoint(playerView, entity, targetPosition, spawnPoint)) {}
-                else if (!knownEnemies.empty() && GetNearestPosition(entity.position, knownEnemies, targetPosition) && GetNearestSpawnPoint(playerView, entity, targetPosition, spawnPoint)) {}
-                else if (!knownEnemySpawns.empty() && GetNearestPosition(entity.position, knownEnemySpawns, targetPosition) && GetNearestSpawnPoint(playerView, entity, targetPosition, spawnPoint)) {}
+            EntityType unitType;
 
-                buildAction = shared_ptr<BuildAction>(new BuildAction(RANGED_UNIT, spawnPoint));
-            }
-
-            // Spawn ranged units when enemy troops are in our base.
-            if (SearchForEnemies(playerView, entity, targetPosition, targetId, baseSize + rangedBase.sightRange))
-                if (GetNearestSpawnPoint(playerView, entity, targetPosition, spawnPoint))
-                    buildAction = shared_ptr<BuildAction>(new BuildAction(RANGED_UNIT, spawnPoint));
+            if (GetProduction(entity, unitType, spawnPoint))
+                buildAction = MakeBuildAction(lastAction, unitType, spawnPoint);
         }
         /*
         ===================================================================================================
@@ -1084,29 +5247,36 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
         */
         else if (entity.entityType == BUILDER_UNIT)
         {
+            // Keeps mining while nothing the intent depends on has changed
+            if (lastAction && IsIntentValid(playerView, entity))
+            {
+                moveAction = lastAction->moveAction;
+                attackAction = lastAction->attackAction;
+                unitIntents[entity.id].tick = playerView.currentTick;
+            }
             // Attack enemy builders when there're no more resources left
-            if (/*!playerView.fogOfWar && */!numOfResources && SearchForEnemies(playerView, entity, targetPosition, targetId, mapSize, { BUILDER_UNIT }))
+            else if (/*!playerView.fogOfWar && */!numOfVisibleFrontier && SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, mapSize, { BUILDER_UNIT }))
             {
                 if (Move(playerView, entity, targetPosition, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), shared_ptr<AutoAttack>(new AutoAttack(properties.sightRange, { BUILDER_UNIT }))));
+                attackAction = MakeAttackAction(lastAction, targetId, properties.sightRange, { BUILDER_UNIT });
             }
             // Attack enemies bases when there're no more resources left
-            else if (/*!playerView.fogOfWar && */!numOfResources && SearchForEnemies(playerView, entity, targetPosition, targetId, mapSize, { BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE }))
+            else if (/*!playerView.fogOfWar && */!numOfVisibleFrontier && SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, mapSize, { BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE }))
             {
                 if (Move(playerView, entity, targetPosition, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), shared_ptr<AutoAttack>(new AutoAttack(properties.sightRange, { BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE }))));
+                attackAction = MakeAttackAction(lastAction, targetId, properties.sightRange, { BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE });
             }
             // Attack other enemies when there're no more resources left
-            else if (/*!playerView.fogOfWar && */!numOfResources && SearchForEnemies(playerView, entity, targetPosition, targetId, mapSize, { MELEE_UNIT, RANGED_UNIT }))
+            else if (/*!playerView.fogOfWar && */!numOfVisibleFrontier && SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, mapSize, { MELEE_UNIT, RANGED_UNIT }))
             {
                 if (Move(playerView, entity, targetPosition, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), shared_ptr<AutoAttack>(new AutoAttack(properties.sightRange, { MELEE_UNIT, RANGED_UNIT }))));
+                attackAction = MakeAttackAction(lastAction, targetId, properties.sightRange, { MELEE_UNIT, RANGED_UNIT });
             }
             // Attack enemies at base when there're no troops
             /*else if (!numOfTroops && SearchForEnemies(playerView, entity, position, targetId, baseSize, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT }))
@@ -1117,33 +5287,28 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
                 attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), shared_ptr<AutoAttack>(new AutoAttack(properties.sightRange, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT }))));
             }*/
             // Attack near builders
-            else if (SearchForEnemies(playerView, entity, targetPosition, targetId, builderAttackBuilderDistance, { BUILDER_UNIT }) && !GetNumberOfTroops(playerView, entity, player_t::PLAYER_ALLY, buildersRunAwayDistance))
+            else if (SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, builderAttackBuilderDistance, { BUILDER_UNIT }) && !GetNumberOfTroops(entity, player_t::PLAYER_ALLY, buildersRunAwayDistance))
             {
                 if (Move(playerView, entity, targetPosition, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), shared_ptr<AutoAttack>(new AutoAttack(properties.sightRange, { BUILDER_UNIT }))));
+                attackAction = MakeAttackAction(lastAction, targetId, properties.sightRange, { BUILDER_UNIT });
             }
             // Attack near enemies bases when there're no enemy troops
-            else if (SearchForEnemies(playerView, entity, targetPosition, targetId, builderAttackBuilderDistance, { BUILDER_BASE, MELEE_BASE, RANGED_BASE }) && !GetNumberOfTroops(playerView, entity, player_t::PLAYER_ALLY, buildersRunAwayDistance))
+            else if (SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, builderAttackBuilderDistance, { BUILDER_BASE, MELEE_BASE, RANGED_BASE }) && !GetNumberOfTroops(entity, player_t::PLAYER_ALLY, buildersRunAwayDistance))
             {
                 if (Move(playerView, entity, targetPosition, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), shared_ptr<AutoAttack>(new AutoAttack(properties.sightRange, { BUILDER_BASE, MELEE_BASE, RANGED_BASE }))));
+                attackAction = MakeAttackAction(lastAction, targetId, properties.sightRange, { BUILDER_BASE, MELEE_BASE, RANGED_BASE });
             }
             // Build/Repair buildings
-            else if ((resources >= 50 || numOfBuilders > 1) &&
-                (!numOfRangedBases && SearchBuildingForRepair(playerView, entity, targetId, targetEntity, positionsForBuilding, mapSize, { MELEE_BASE }) || SearchBuildingForRepair(playerView, entity, targetId, targetEntity, positionsForBuilding, builderRepairDistance, { BUILDER_BASE, RANGED_BASE, HOUSE, TURRET })) &&
-                IsEntityCloserToPosition(playerView, entity, targetEntity->position, numberOfBuildersForRepair))
+            else if ((resources >= 50 || numOfBuilders > 1) && GetRepairAssignment(entity, targetId, positionForBuilding))
             {
-                if (GetNearestPosition(entity.position, positionsForBuilding, positionForBuilding))
-                {
-                    if (Move(playerView, entity, positionForBuilding, movePosition))
-                        moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                if (Move(playerView, entity, positionForBuilding, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                    repairAction = shared_ptr<RepairAction>(new RepairAction(targetId));
-                }
+                repairAction = MakeRepairAction(lastAction, targetId);
             }
             // Attack enemies at base
             /*else if (entity.position.x < baseSize && entity.position.y < baseSize && SearchForEnemies(playerView, entity, position, targetId, baseSize, { MELEE_UNIT, RANGED_UNIT }))
@@ -1155,27 +5320,35 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
                 attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), shared_ptr<AutoAttack>(new AutoAttack(properties.sightRange, { MELEE_UNIT, RANGED_UNIT }))));
             }*/
             // Run away from enemy troops
-            else if (!GetNumberOfTroops(playerView, entity, player_t::PLAYER_ALLY, 1) && !SearchForResources(playerView, entity, targetPosition, targetId, 1) && SearchForEnemies(playerView, entity, targetPosition, targetId, buildersRunAwayDistance, { MELEE_UNIT, RANGED_UNIT, TURRET }))
+            else if (!GetNumberOfTroops(entity, player_t::PLAYER_ALLY, 1) && !SearchForResources(playerView, entity, targetPosition, targetId, 1) && SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, buildersRunAwayDistance, { MELEE_UNIT, RANGED_UNIT, TURRET }))
             {
-                Vec2Int to(entity.position.x - (targetPosition.x - entity.position.x), entity.position.y - (targetPosition.y - entity.position.y));
+                // Searches for the path only when the builder is cornered
+                if (StepToSafety(entity, movePosition))
+                {
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
+                }
+                else
+                {
+                    Vec2Int to(entity.position.x - (targetPosition.x - entity.position.x), entity.position.y - (targetPosition.y - entity.position.y));
 
-                if (to.x < 0) to.x = 0;
-                if (to.x >= MAP_SIZE) to.x = MAP_SIZE - 1;
-                if (to.y < 0) to.y = 0;
-                if (to.y >= MAP_SIZE) to.y = MAP_SIZE - 1;
+                    if (to.x < 0) to.x = 0;
+                    if (to.x >= MAP_SIZE) to.x = MAP_SIZE - 1;
+                    if (to.y < 0) to.y = 0;
+                    if (to.y >= MAP_SIZE) to.y = MAP_SIZE - 1;
 
-                if (Move(playerView, entity, to, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                    if (Move(playerView, entity, to, movePosition))
+                        moveAction = MakeMoveAction(lastAction, movePosition, false, true);
+                }
             }
             // Building builder base if it doesn't exist
-            else if (!numOfBuilderBases && resources >= builderBase.buildScore && SearchPlaceForBuilding(playerView, entity, positionForBuilding, positionsForBuilding, BUILDER_BASE) && IsEntityCloserToPosition(playerView, entity, positionForBuilding))
+            else if (buildPlans[BUILDER_BASE].builder == entity.id)
             {
-                if (GetNearestPosition(entity.position, positionsForBuilding, targetPosition))
+                if (GetNearestPosition(entity.position, buildPlans[BUILDER_BASE].positionsForBuilding, targetPosition))
                 {
                     if (Move(playerView, entity, targetPosition, movePosition))
-                        moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                        moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                    buildAction = shared_ptr<BuildAction>(new BuildAction(BUILDER_BASE, positionForBuilding));
+                    buildAction = MakeBuildAction(lastAction, BUILDER_BASE, buildPlans[BUILDER_BASE].position);
                 }
             }
             // Building melee base if it doesn't exist
@@ -1190,49 +5363,69 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
                 }
             }*/
             // Building ranged base if it doesn't exist
-            else if (!numOfRangedBases && resources >= rangedBase.buildScore && SearchPlaceForBuilding(playerView, entity, positionForBuilding, positionsForBuilding, RANGED_BASE, baseSize) && IsEntityCloserToPosition(playerView, entity, positionForBuilding))
+            else if (buildPlans[RANGED_BASE].builder == entity.id)
             {
-                if (GetNearestPosition(entity.position, positionsForBuilding, targetPosition))
+                if (GetNearestPosition(entity.position, buildPlans[RANGED_BASE].positionsForBuilding, targetPosition))
                 {
                     if (Move(playerView, entity, targetPosition, movePosition))
-                        moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                        moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                    buildAction = shared_ptr<BuildAction>(new BuildAction(RANGED_BASE, positionForBuilding));
+                    buildAction = MakeBuildAction(lastAction, RANGED_BASE, buildPlans[RANGED_BASE].position);
                 }
             }
             // Building houses
-            else if (((!playerView.fogOfWar || numOfRangedBases || numOfMeleeBases) || (!numOfRangedBases && !numOfMeleeBases)) && (resources >= house.buildScore * (numOfHouses + 1)) && ((population < 30 && population >= maxPopulation - house.populationProvide) || (population >= 30 && population >= maxPopulation - house.populationProvide)) && SearchPlaceForBuilding(playerView, entity, positionForBuilding, positionsForBuilding, HOUSE) && IsEntityCloserToPosition(playerView, entity, positionForBuilding))
+            else if (buildPlans[HOUSE].builder == entity.id)
             {
-                if (GetNearestPosition(entity.position, positionsForBuilding, targetPosition))
+                if (GetNearestPosition(entity.position, buildPlans[HOUSE].positionsForBuilding, targetPosition))
                 {
                     if (Move(playerView, entity, targetPosition, movePosition))
-                        moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                        moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                    buildAction = shared_ptr<BuildAction>(new BuildAction(HOUSE, positionForBuilding));
+                    buildAction = MakeBuildAction(lastAction, HOUSE, buildPlans[HOUSE].position);
                 }
             }
             // Gather resources
             else if (SearchForResources(playerView, entity, targetPosition, targetId))
             {
                 if (Move(playerView, entity, targetPosition, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
                 
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), nullptr));
+                attackAction = MakeAttackAction(lastAction, targetId);
+
+                // Only a miner next to its resource can keep the intent
+                if (abs(targetPosition.x - entity.position.x) + abs(targetPosition.y - entity.position.y) == 1)
+                {
+                    unitIntent_t &intent = unitIntents[entity.id];
+                    intent.intent = INTENT_GATHER;
+                    intent.targetId = targetId;
+                    intent.target = targetPosition;
+                    intent.position = entity.position;
+                    intent.tick = playerView.currentTick;
+                }
             }
-            // If builders don't see any resources or enemies, send them to any enemy base
+            // If builders don't see any resources or enemies, explore the fog or send them to any enemy base
             else
             {
-                if (GetNearestPosition(entity.position, knownEnemySpawns, targetPosition))
+                if (StepToFrontier(playerView, entity, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
+                else if (GetNearestPosition(entity.position, knownEnemySpawns, targetPosition))
                 {
                     if (playerView.fogOfWar)
                     {
-                        if (Move(playerView, entity, knownEnemySpawns[knownEnemySpawns.size() == 1 ? 0 : entity.id % 2], movePosition))
-                            moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                        const Vec2Int &spawn = knownEnemySpawns[knownEnemySpawns.size() == 1 ? 0 : entity.id % 2];
+
+#ifdef BACKGROUND_PRECOMPUTE
+                        if (StepToSpawn(entity, spawn, movePosition))
+                            moveAction = MakeMoveAction(lastAction, movePosition, false, true);
+                        else
+#endif
+                        if (GetReachableTarget(playerView, entity, spawn, reachableTarget) && Move(playerView, entity, reachableTarget, movePosition, PATH_MODE_JUMP))
+                            moveAction = MakeMoveAction(lastAction, movePosition, false, true);
                     }
                     else
                     {
                         if (Move(playerView, entity, targetPosition, movePosition))
-                            moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                            moveAction = MakeMoveAction(lastAction, movePosition, false, true);
                     }
                 }
             }
@@ -1245,59 +5438,89 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
         else if (entity.entityType == MELEE_UNIT || entity.entityType == RANGED_UNIT)
         {
             // Run away from enemy troops when it is not worth it
-            if (Distance(Vec2Int(0, 0), entity.position) > baseSize + ranged.sightRange && !IsItWorthToAttack(playerView, entity, 7, 7))
+            if (!IsInBase(entity.position, baseTerritoryRange + ranged.sightRange) && !IsSquadWorthToAttack(playerView, entity, 7, 7))
             {
-                moveAction = shared_ptr<MoveAction>(new MoveAction(Vec2Int(0, 0), true, true));
+                // The field can't be followed through standing units, turret fire or from outside the territory, the path goes to the nearest building then
+                if (StepToTerritory(entity, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
+                else if (!GetNearestBuilding(entity.position, targetPosition))
+                    moveAction = MakeMoveAction(lastAction, Vec2Int(0, 0), true, true);
+                else if (GetReachableTarget(playerView, entity, targetPosition, reachableTarget) && Move(playerView, entity, reachableTarget, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
+                else
+                    moveAction = MakeMoveAction(lastAction, targetPosition, true, true);
+
+                // Keeps shooting the planned target on the way
+                int focusId = GetFocusTarget(playerView, entity, -1);
+
+                if (focusId != -1)
+                    attackAction = MakeAttackAction(lastAction, focusId);
             }
             // Attack the nearest builder base using only the ranged units
-            else if (entity.entityType == RANGED_UNIT && ((float)numOfTroops / (float)maxPopulation >= entitiesRatio || entity.position.x > baseSize && entity.position.y > baseSize) && SearchForEnemies(playerView, entity, targetPosition, targetId, troopsAttackBaseDistance, { BUILDER_BASE }))
+            else if (entity.entityType == RANGED_UNIT && ((float)numOfTroops / (float)maxPopulation >= entitiesRatio || !IsInBase(entity.position)) && SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, troopsAttackBaseDistance, { BUILDER_BASE }))
             {
-                if (Move(playerView, entity, targetPosition, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                if (GetReachableTarget(playerView, entity, targetPosition, reachableTarget) && Move(playerView, entity, reachableTarget, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), nullptr));
+                attackAction = MakeAttackAction(lastAction, GetFocusTarget(playerView, entity, targetId));
             }
             // Attack the nearest builder if there're no nearby enemy troops
-            else if (((float)numOfTroops / (float)maxPopulation >= entitiesRatio || entity.position.x > baseSize && entity.position.y > baseSize) && SearchForEnemies(playerView, entity, targetPosition, targetId, troopsAttackBuilderDistance, { BUILDER_UNIT }) && !GetNumberOfTroops(playerView, entity, player_t::PLAYER_ENEMY, enemyRunAwayRange))
+            else if (((float)numOfTroops / (float)maxPopulation >= entitiesRatio || !IsInBase(entity.position)) && SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, troopsAttackBuilderDistance, { BUILDER_UNIT }) && !GetNumberOfTroops(entity, player_t::PLAYER_ENEMY, enemyRunAwayRange))
             {
-                if (Move(playerView, entity, targetPosition, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                if (GetReachableTarget(playerView, entity, targetPosition, reachableTarget) && Move(playerView, entity, reachableTarget, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), nullptr));
+                attackAction = MakeAttackAction(lastAction, GetFocusTarget(playerView, entity, targetId));
             }
             // Attack the nearest melee/ranged bases using only the ranged units
-            else if (entity.entityType == RANGED_UNIT && ((float)numOfTroops / (float)maxPopulation >= entitiesRatio || entity.position.x > baseSize && entity.position.y > baseSize) && SearchForEnemies(playerView, entity, targetPosition, targetId, troopsAttackBaseDistance, { MELEE_BASE, RANGED_BASE }))
+            else if (entity.entityType == RANGED_UNIT && ((float)numOfTroops / (float)maxPopulation >= entitiesRatio || !IsInBase(entity.position)) && SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, troopsAttackBaseDistance, { MELEE_BASE, RANGED_BASE }))
             {
-                if (Move(playerView, entity, targetPosition, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                if (GetReachableTarget(playerView, entity, targetPosition, reachableTarget) && Move(playerView, entity, reachableTarget, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), nullptr));
+                attackAction = MakeAttackAction(lastAction, GetFocusTarget(playerView, entity, targetId));
             }
             // Attack the nearest enemy
-            else if (SearchForEnemies(playerView, entity, targetPosition, targetId, 99999, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT, BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE, WALL }))
+            else if (SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, 99999, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT, BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE, WALL }))
             {
-                if (Move(playerView, entity, targetPosition, movePosition))
-                    moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                // Far targets are approached together with the squad
+                if (Distance(entity.position, targetPosition) > squadEngageRange && FollowSquad(playerView, entity, targetPosition, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
+                else if (GetReachableTarget(playerView, entity, targetPosition, reachableTarget) && Move(playerView, entity, reachableTarget, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
 
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), nullptr));
+                attackAction = MakeAttackAction(lastAction, GetFocusTarget(playerView, entity, targetId));
             }
             // Move to the last known enemy positions on the map if we don't see them anymore
-            else if (playerView.fogOfWar && !SearchForEnemies(playerView, entity, targetPosition, targetId, 99999, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT, BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE, WALL }) && !knownEnemies.empty())
+            else if (playerView.fogOfWar && !SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, 99999, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT, BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE, WALL }) && !knownEnemies.empty())
             {
-                if (GetNearestPosition(entity.position, knownEnemies, targetPosition))
+                if (FollowSquad(playerView, entity, targetPosition, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
+                else if (GetNearestPosition(entity.position, knownEnemies, targetPosition))
                 {
-                    if (Move(playerView, entity, targetPosition, movePosition))
-                        moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                    if (GetReachableTarget(playerView, entity, targetPosition, reachableTarget) && Move(playerView, entity, reachableTarget, movePosition, PATH_MODE_JUMP))
+                        moveAction = MakeMoveAction(lastAction, movePosition, false, true);
                 }
             }
             // Move to the known enemy spawns if we don't see enemies
-            else if (playerView.fogOfWar && !SearchForEnemies(playerView, entity, targetPosition, targetId, 99999, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT, BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE, WALL }))
+            else if (playerView.fogOfWar && !SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, 99999, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT, BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE, WALL }))
             {
-                if (GetNearestPosition(entity.position, knownEnemySpawns, targetPosition))
+                if (FollowSquad(playerView, entity, targetPosition, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
+                else if (GetNearestPosition(entity.position, knownEnemySpawns, targetPosition))
                 {
-                    if (Move(playerView, entity, knownEnemySpawns[knownEnemySpawns.size() == 1 ? 0 : entity.id % 2], movePosition))
-                        moveAction = shared_ptr<MoveAction>(new MoveAction(movePosition, false, true));
+                    const Vec2Int &spawn = knownEnemySpawns[knownEnemySpawns.size() == 1 ? 0 : entity.id % 2];
+
+#ifdef BACKGROUND_PRECOMPUTE
+                    if (StepToSpawn(entity, spawn, movePosition))
+                        moveAction = MakeMoveAction(lastAction, movePosition, false, true);
+                    else
+#endif
+                    if (GetReachableTarget(playerView, entity, spawn, reachableTarget) && Move(playerView, entity, reachableTarget, movePosition, PATH_MODE_JUMP))
+                        moveAction = MakeMoveAction(lastAction, movePosition, false, true);
                 }
+                else if (StepToFrontier(playerView, entity, movePosition))
+                    moveAction = MakeMoveAction(lastAction, movePosition, false, true);
             }
         }
         /*
@@ -1307,13 +5530,40 @@ Action MyStrategy::getAction(const PlayerView &playerView, DebugInterface *debug
         */
         else if (entity.entityType == TURRET)
         {
-            if (SearchForEnemies(playerView, entity, targetPosition, targetId, turret.attack->attackRange))
-                attackAction = shared_ptr<AttackAction>(new AttackAction(shared_ptr<int>(new int(targetId)), shared_ptr<AutoAttack>(new AutoAttack(properties.sightRange, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT, BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE, WALL, TURRET }))));
+            if (SearchForEnemies(playerView, entity, enemies, targetPosition, targetId, turret.attack->attackRange))
+                attackAction = MakeAttackAction(lastAction, targetId, properties.sightRange, { BUILDER_UNIT, MELEE_UNIT, RANGED_UNIT, BUILDER_BASE, MELEE_BASE, RANGED_BASE, HOUSE, WALL, TURRET });
         }
 
-        result.entityActions[entity.id] = EntityAction(moveAction, buildAction, attackAction, repairAction);
+#ifdef GAME_TELEMETRY
+        if (entity.entityType == BUILDER_UNIT && !moveAction && !buildAction && !attackAction && !repairAction)
+            telemetry.idleBuilders++;
+#endif
+
+        EntityAction action(moveAction, buildAction, attackAction, repairAction);
+
+        if (!sendOnlyChangedActions || !lastAction || !IsSameEntityAction(*lastAction, action))
+            result.entityActions[entity.id] = action;
+
+        currentActions[entity.id] = action;
     }
 
+    lastActions.swap(currentActions);
+
+#ifdef BACKGROUND_PRECOMPUTE
+    StartPrecompute(playerView);
+#endif
+
+#ifdef SLOW_TICK_WATCHDOG
+    double tickMs = chrono::duration<double, milli>(chrono::steady_clock::now() - tickStart).count();
+
+    if (tickMs > slowTickThreshold && numOfSlowTickDumps < slowTickMaxDumps)
+        DumpSlowTick(playerView, tickMs);
+#endif
+
+#ifdef GAME_TELEMETRY
+    WriteTelemetry(playerView, chrono::duration<double, milli>(chrono::steady_clock::now() - telemetryStart).count(), resources, population, maxPopulation, numOfBuilders);
+#endif
+
     return result;
 }
 
@@ -1328,4 +5578,4 @@ void MyStrategy::debugUpdate(const PlayerView &playerView, DebugInterface &debug
     debugInterface.getState();
 
     //debugInterface.send(DebugCommand::Add(shared_ptr<DebugData>(new DebugData::Log(string("Test")))));
-}
\ No newline at end of file
+}
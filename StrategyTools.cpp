@@ -0,0 +1,1033 @@
+/*
+===================================================================================================
+    STRATEGY TOOLS
+
+    Build StrategyTools.cpp instead of MyStrategy.cpp and main.cpp together with the model sources
+    to get a command line tool for the strategy internals, the strategy is included with
+    STRATEGY_TOOLS defined:
+
+        tools bench [view files...]     Kernel microbenchmarks as JSON, view files are
+                                        serialized PlayerView messages (recorded maps)
+        tools oracle [seed] [rounds]    Randomized differential test of the kernels against
+                                        their references, needs -DORACLE_VALIDATION
+        tools replay file [runs]        Runs the tick saved by the slow tick watchdog again,
+                                        under perf or any other profiler
+        tools summarize files...        Sums up the telemetry files of -DGAME_TELEMETRY games
+                                        as JSON, the later files are compared with the first
+===================================================================================================
+*/
+#define STRATEGY_TOOLS
+#include "MyStrategy.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const int benchMinIterations = 20;
+const double benchMinSeconds = 0.2;
+const double benchMinBatchSeconds = 0.001;
+
+// Results of the pure kernels go here so they aren't optimized out
+volatile int benchSink;
+
+/*
+===================
+JsonString
+
+Quotes the text for the JSON output, the file names can hold anything
+===================
+*/
+string JsonString(const string &text)
+{
+    string json = "\"";
+
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            json += '\\';
+            json += (char)c;
+        }
+        else if (c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            json += escaped;
+        }
+        else
+        {
+            json += (char)c;
+        }
+    }
+
+    return json + "\"";
+}
+
+/*
+===================
+FileInputStream
+===================
+*/
+class FileInputStream : public InputStream
+{
+public:
+    FileInputStream(FILE *file) : file(file) {}
+
+    void readBytes(char *buffer, size_t byteCount) override
+    {
+        if (fread(buffer, 1, byteCount, file) != byteCount)
+            throw runtime_error("Unexpected end of file");
+    }
+
+private:
+    FILE *file;
+};
+
+/*
+===================
+MemoryInputStream
+===================
+*/
+class MemoryInputStream : public InputStream
+{
+public:
+    MemoryInputStream(const vector<char> &data) : data(data) {}
+
+    void readBytes(char *buffer, size_t byteCount) override
+    {
+        if (position + byteCount > data.size())
+            throw runtime_error("Unexpected end of data");
+
+        memcpy(buffer, data.data() + position, byteCount);
+        position += byteCount;
+    }
+
+private:
+    const vector<char> &data;
+    size_t position = 0;
+};
+
+/*
+===================
+CacheMissCounter
+
+Hardware cache-miss counter of the process, it's unavailable on non-Linux systems or when perf events are restricted
+===================
+*/
+class CacheMissCounter
+{
+public:
+    CacheMissCounter()
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    bool Available() const { return fd >= 0; }
+
+    void Start()
+    {
+#ifdef __linux__
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    long long Stop()
+    {
+        long long count = 0;
+#ifdef __linux__
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+        return count;
+    }
+
+private:
+    int fd = -1;
+};
+
+/*
+===================
+MakeDefaultProperties
+
+Entity properties of the default game settings for the synthetic maps
+===================
+*/
+unordered_map<EntityType, EntityProperties> MakeDefaultProperties()
+{
+    unordered_map<EntityType, EntityProperties> properties;
+    auto attack = [](int range, int damage, bool collectResource) { return shared_ptr<AttackProperties>(new AttackProperties(range, damage, collectResource)); };
+    auto build = [](const vector<EntityType> &options) { return shared_ptr<BuildProperties>(new BuildProperties(options, nullptr)); };
+
+    properties[WALL] = EntityProperties(1, 0, 10, false, 0, 0, 50, 10, 0, 0, nullptr, nullptr, nullptr);
+    properties[HOUSE] = EntityProperties(3, 50, 50, false, 5, 0, 50, 50, 5, 0, nullptr, nullptr, nullptr);
+    properties[BUILDER_BASE] = EntityProperties(5, 500, 500, false, 5, 0, 300, 500, 5, 0, build({ BUILDER_UNIT }), nullptr, nullptr);
+    properties[BUILDER_UNIT] = EntityProperties(1, 10, 10, true, 0, 1, 10, 10, 10, 0, build({ HOUSE, BUILDER_BASE, MELEE_BASE, RANGED_BASE, TURRET }), attack(1, 1, true), shared_ptr<RepairProperties>(new RepairProperties({ HOUSE, BUILDER_BASE, MELEE_BASE, RANGED_BASE, TURRET }, 1)));
+    properties[MELEE_BASE] = EntityProperties(5, 500, 500, false, 5, 0, 300, 500, 5, 0, build({ MELEE_UNIT }), nullptr, nullptr);
+    properties[MELEE_UNIT] = EntityProperties(1, 20, 20, true, 0, 1, 50, 20, 10, 0, nullptr, attack(1, 5, false), nullptr);
+    properties[RANGED_BASE] = EntityProperties(5, 500, 500, false, 5, 0, 300, 500, 5, 0, build({ RANGED_UNIT }), nullptr, nullptr);
+    properties[RANGED_UNIT] = EntityProperties(1, 30, 30, true, 0, 1, 10, 30, 10, 0, nullptr, attack(5, 5, false), nullptr);
+    properties[RESOURCE] = EntityProperties(1, 0, 0, false, 0, 0, 30, 0, 0, 1, nullptr, nullptr, nullptr);
+    properties[TURRET] = EntityProperties(2, 50, 50, false, 0, 0, 100, 50, 10, 0, nullptr, attack(5, 5, false), nullptr);
+
+    return properties;
+}
+
+/*
+===================
+MakeSyntheticView
+
+Our base is in the (0, 0) corner and the enemy base is in the opposite one
+===================
+*/
+PlayerView MakeSyntheticView(unsigned int seed, int resourceDensity, int numOfUnits, bool fogOfWar)
+{
+    unsigned int random = seed;
+    auto nextRandom = [&random](int range) { random = random * 1103515245u + 12345u; return (int)((random >> 8) % (unsigned int)range); };
+    unordered_map<EntityType, EntityProperties> properties = MakeDefaultProperties();
+    vector<Entity> entities;
+    bool occupied[MAP_SIZE][MAP_SIZE] = {};
+    int id = 1;
+
+    auto add = [&](int playerId, EntityType type, int x, int y)
+    {
+        int size = properties.at(type).size;
+
+        if (x < 0 || y < 0 || x + size > MAP_SIZE || y + size > MAP_SIZE) return;
+
+        for (int i = x; i < x + size; i++)
+            for (int j = y; j < y + size; j++)
+                if (occupied[i][j]) return;
+
+        for (int i = x; i < x + size; i++)
+            for (int j = y; j < y + size; j++)
+                occupied[i][j] = true;
+
+        entities.push_back(Entity(id++, playerId ? shared_ptr<int>(new int(playerId)) : nullptr, type, Vec2Int(x, y), properties.at(type).maxHealth, true));
+    };
+
+    add(1, BUILDER_BASE, 5, 5);
+    add(1, HOUSE, 0, 0);
+    add(1, HOUSE, 0, 4);
+    add(1, TURRET, 12, 12);
+    add(2, BUILDER_BASE, 70, 70);
+    add(2, RANGED_BASE, 60, 72);
+    add(2, TURRET, 62, 62);
+
+    for (int n = 0; n < numOfUnits; n++)
+    {
+        add(1, BUILDER_UNIT, 10 + nextRandom(15), 10 + nextRandom(15));
+        add(1, n % 2 ? RANGED_UNIT : MELEE_UNIT, 20 + nextRandom(25), 20 + nextRandom(25));
+        add(2, n % 3 ? RANGED_UNIT : BUILDER_UNIT, 40 + nextRandom(30), 40 + nextRandom(30));
+    }
+
+    for (int n = 0; n < MAP_SIZE * MAP_SIZE * resourceDensity / 100; n++)
+    {
+        int x = nextRandom(MAP_SIZE);
+        int y = nextRandom(MAP_SIZE);
+
+        if (x + y > 25 && x + y < 2 * MAP_SIZE - 25)
+            add(0, RESOURCE, x, y);
+    }
+
+    return PlayerView(1, MAP_SIZE, fogOfWar, properties, 1000, 1000, 0, { Player(1, 0, 1000), Player(2, 0, 1000) }, entities);
+}
+
+/*
+===================
+LoadPlayerView
+===================
+*/
+bool LoadPlayerView(const char *fileName, PlayerView &playerView)
+{
+    FILE *file = fopen(fileName, "rb");
+
+    if (!file)
+        return false;
+
+    try
+    {
+        FileInputStream stream(file);
+        playerView = PlayerView::readFrom(stream);
+    }
+    catch (const exception &)
+    {
+        fclose(file);
+        return false;
+    }
+
+    fclose(file);
+    return true;
+}
+
+/*
+===================
+BenchKernel
+
+Runs the kernel until both the minimal iterations and the minimal time are reached and prints a JSON record
+===================
+*/
+template <typename Kernel>
+void BenchKernel(const string &mapName, const string &kernelName, Kernel kernel, bool &first)
+{
+    static CacheMissCounter cacheMisses;
+    long long iterations = 0;
+    long long batch = 1;
+    long long misses = 0;
+    double seconds = 0.0;
+
+    // Small kernels are timed in batches so the timer and counter calls don't dominate
+    while (iterations < benchMinIterations || seconds < benchMinSeconds)
+    {
+        auto start = chrono::steady_clock::now();
+        cacheMisses.Start();
+
+        for (long long i = 0; i < batch; i++)
+            kernel();
+
+        misses += cacheMisses.Stop();
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        seconds += elapsed;
+        iterations += batch;
+
+        if (elapsed < benchMinBatchSeconds)
+            batch *= 2;
+    }
+
+    printf("%s\n    { \"map\": %s, \"kernel\": %s, \"iterations\": %lld, \"nsPerOp\": %.1f, ", first ? "" : ",", JsonString(mapName).c_str(), JsonString(kernelName).c_str(), iterations, seconds * 1e9 / iterations);
+
+    if (cacheMisses.Available())
+        printf("\"cacheMissesPerOp\": %.1f }", (double)misses / iterations);
+    else
+        printf("\"cacheMissesPerOp\": null }");
+
+    first = false;
+}
+
+/*
+===================
+BenchSearchPath
+
+Searches from the builder to the far corner of the map on the given grid storage
+===================
+*/
+template <typename T, gridLayout_t layout>
+void BenchSearchPath(const string &mapName, const string &kernelName, const PlayerView &playerView, const Entity &builder, bool &first)
+{
+    static grid_t<T, layout> path;
+    static grid_t<T, layout> pathTemplate;
+    vector<Vec2Int> positions;
+
+    pathTemplate.ForEach([](int i, int j, T &cell)
+    {
+        cell = worldMap[i][j] == TILE_EMPTY ? PATH_EMPTY : worldMap[i][j] == TILE_DESTROYABLE ? PATH_DESTROYABLE : PATH_BLOCKED;
+    });
+
+    pathTemplate(builder.position.x, builder.position.y) = PATH_START;
+    pathTemplate(MAP_SIZE - 1, MAP_SIZE - 1) = PATH_TARGET;
+
+    BenchKernel(mapName, kernelName, [&]() { path = pathTemplate; SearchPath(playerView, path, positions); }, first);
+}
+
+/*
+===================
+BenchMap
+===================
+*/
+void BenchMap(const string &mapName, const PlayerView &playerView, bool &first)
+{
+    const Entity *builder = nullptr;
+    const Entity *troop = nullptr;
+    const Entity *enemy = nullptr;
+
+    for (int type = 0; type < NUM_ENTITY_TYPES; type++)
+        allyPositions[type].Clear();
+
+    allyTroops.Clear();
+    enemies.Clear();
+
+    for (int index = 0; index < (int)playerView.entities.size(); index++)
+    {
+        const Entity &entity = playerView.entities[index];
+
+        if (!entity.playerId) continue;
+
+        if (*entity.playerId == playerView.myId)
+        {
+            allyPositions[entity.entityType].Add(entity.position, index);
+
+            if (entity.entityType == BUILDER_UNIT && !builder) builder = &entity;
+            if ((entity.entityType == MELEE_UNIT || entity.entityType == RANGED_UNIT) && !troop) troop = &entity;
+            if (entity.entityType == MELEE_UNIT || entity.entityType == RANGED_UNIT) allyTroops.Add(entity.position, index);
+        }
+        else
+        {
+            if (!enemy || Distance(Vec2Int(0, 0), entity.position) > Distance(Vec2Int(0, 0), enemy->position)) enemy = &entity;
+            enemies.Add(entity.position, index);
+        }
+    }
+
+    for (int i = 0; i < MAP_SIZE; i++)
+    {
+        for (int j = 0; j < MAP_SIZE; j++)
+        {
+            worldMap[i][j] = buildMap[i][j] = TILE_EMPTY;
+            unitPositionsAtLastTick[i][j] = unitPositionsAtCurrentTick[i][j] = 0;
+        }
+    }
+
+    BenchKernel(mapName, "MakeVisibilityMask", [&]() { MakeVisibilityMask(playerView); }, first);
+    BenchKernel(mapName, "MakeMap", [&]() { MakeMap(playerView, worldMap); }, first);
+    BenchKernel(mapName, "MakeMap(forBuilding)", [&]() { MakeMap(playerView, buildMap, true); }, first);
+    BenchKernel(mapName, "UpdateResourceIndex(rebuild)", [&]() { ClearResourceIndex(); UpdateResourceIndex(playerView); }, first);
+    BenchKernel(mapName, "UpdateResourceIndex", [&]() { UpdateResourceIndex(playerView); }, first);
+    BenchKernel(mapName, "UpdateExploration(rebuild)", [&]()
+    {
+        for (int i = 0; i < MAP_SIZE; i++)
+        {
+            exploredMask[i].reset();
+            frontierMask[i].reset();
+        }
+
+        numOfExploredCells = 0;
+        UpdateExploration();
+    }, first);
+    BenchKernel(mapName, "UpdateExploration", [&]() { UpdateExploration(); }, first);
+    BenchKernel(mapName, "MakeFrontierField", [&]() { MakeFrontierField(playerView); }, first);
+
+    BenchKernel(mapName, "UpdateTerritory(rebuild)", [&]() { territoryValid = false; UpdateTerritory(playerView); }, first);
+    BenchKernel(mapName, "UpdateTerritory", [&]() { UpdateTerritory(playerView); }, first);
+
+    // A resource next to the first house comes and goes, every update takes the cells behind it
+    if (allyPositions[HOUSE].Size())
+    {
+        Vec2Int cell(allyPositions[HOUSE].x[0] + playerView.entityProperties.at(HOUSE).size, allyPositions[HOUSE].y[0]);
+
+        if (cell.x < MAP_SIZE && !resourceMask[cell.x][cell.y])
+        {
+            BenchKernel(mapName, "UpdateTerritory(resource toggled)", [&]()
+            {
+                resourceMask[cell.x].flip(cell.y);
+                UpdateTerritory(playerView);
+            }, first);
+
+            resourceMask[cell.x][cell.y] = false;
+            UpdateTerritory(playerView);
+        }
+    }
+
+    if (builder)
+    {
+        vector<Vec2Int> positions;
+        Vec2Int position;
+        Vec2Int move;
+        int targetId;
+
+        BenchSearchPath<int, GRID_ROW_MAJOR>(mapName, "SearchPath(int)", playerView, *builder, first);
+        BenchSearchPath<int16_t, GRID_ROW_MAJOR>(mapName, "SearchPath(int16)", playerView, *builder, first);
+        BenchSearchPath<int16_t, GRID_TILED>(mapName, "SearchPath(int16, tiled)", playerView, *builder, first);
+        BenchKernel(mapName, "SearchForResources", [&]() { SearchForResources(playerView, *builder, position, targetId); }, first);
+        BenchKernel(mapName, "SearchPlaceForBuilding(ALIGN_IN_CORNER)", [&]() { SearchPlaceForBuilding(playerView, builder, position, positions, HOUSE, 0, ALIGN_IN_CORNER); }, first);
+        BenchKernel(mapName, "SearchPlaceForBuilding(ALIGN_IN_CORNER_CENTER)", [&]() { SearchPlaceForBuilding(playerView, builder, position, positions, RANGED_BASE, 0, ALIGN_IN_CORNER_CENTER); }, first);
+        BenchKernel(mapName, "SearchPlaceForBuilding(ALIGN_AROUND_BUILDER)", [&]() { SearchPlaceForBuilding(playerView, builder, position, positions, HOUSE, 0, ALIGN_AROUND_BUILDER); }, first);
+        BenchKernel(mapName, "MakeOpeningLayout", [&]() { MakeOpeningLayout(playerView); }, first);
+        BenchKernel(mapName, "PlanBuilding", [&]() { int resources = numeric_limits<int>::max(); PlanBuilding(playerView, HOUSE, resources); }, first);
+
+        if (enemy)
+        {
+            MakeMoveMap(playerView);
+            jumpTablesValid = false;
+            BenchKernel(mapName, "UpdateJumpTables(rebuild)", [&]() { jumpTablesValid = false; UpdateJumpTables(); }, first);
+            BenchKernel(mapName, "UpdateJumpTables", [&]() { UpdateJumpTables(); }, first);
+            BenchKernel(mapName, "MakeReachLabels", [&]() { MakeReachLabels(); }, first);
+            BenchKernel(mapName, "Move", [&]() { unitPaths.clear(); Move(playerView, *builder, enemy->position, move); }, first);
+            BenchKernel(mapName, "Move(own tile)", [&]() { unitPaths.clear(); Move(playerView, *builder, builder->position, move); }, first);
+
+            // Every building of the synthetic maps is treated as damaged
+            damagedBuildings.Clear();
+
+            for (const auto type : { BUILDER_BASE, HOUSE, TURRET })
+                for (int n = 0; n < allyPositions[type].Size(); n++)
+                    damagedBuildings.Add(Vec2Int(allyPositions[type].x[n], allyPositions[type].y[n]), allyPositions[type].index[n]);
+
+            BenchKernel(mapName, "DispatchRepairs", [&]() { DispatchRepairs(playerView, false); }, first);
+            repairAssignments.clear();
+            BenchKernel(mapName, "Move(jump)", [&]() { unitPaths.clear(); Move(playerView, *builder, enemy->position, move, PATH_MODE_JUMP); }, first);
+            BenchKernel(mapName, "Move(stored path)", [&]() { Move(playerView, *builder, enemy->position, move); }, first);
+        }
+    }
+
+    if (troop)
+    {
+        const EntityProperties &properties = playerView.entityProperties.at(troop->entityType);
+        Vec2Int target(troop->position.x + properties.sightRange / 2, troop->position.y + properties.sightRange / 2);
+
+        BenchKernel(mapName, "IsAtRange", [&]() { IsAtRange(playerView, *troop, target, properties.sightRange); }, first);
+        BenchKernel(mapName, "MakeSectorPyramid", [&]() { MakeSectorPyramid(playerView); }, first);
+        BenchKernel(mapName, "IsItWorthToAttack", [&]() { IsItWorthToAttack(playerView, *troop, 7, 7); }, first);
+
+        BenchKernel(mapName, "CountInRange(troops)", [&]() { benchSink = CountInRange(troop->position, allyTroops, DISTANCE_SQUARED, SquaredRange(enemyRunAwayRange)); }, first);
+        BenchKernel(mapName, "QueryRegion(troops)", [&]() { benchSink = QueryRegion(troop->position, SquaredRange(enemyRunAwayRange), PLAYER_ALLY, troopTypes); }, first);
+        BenchKernel(mapName, "QueryRegion(map)", [&]() { benchSink = QueryRegion(troop->position, SquaredRange(MAP_SIZE), PLAYER_ENEMY, allEntityTypes); }, first);
+
+        MakeMoveMap(playerView);
+        BenchKernel(mapName, "MakeSquads", [&]() { MakeSquads(playerView); }, first);
+        BenchKernel(mapName, "MakeSafetyMap", [&]() { MakeSafetyMap(playerView); }, first);
+        BenchKernel(mapName, "PlanProduction", [&]() { PlanProduction(playerView, numeric_limits<int>::max(), MAP_SIZE, 0.5f); }, first);
+        productionPlans.clear();
+
+        // In-range scans of every attacker on its own against the allocator
+        // The attackers of the allocator take their in-range enemies from it, so the pair is what a tick pays
+        auto queryAttackers = [&]()
+        {
+            enemyQuery_t query;
+
+            for (const auto &entity : playerView.entities)
+                if (entity.playerId && *entity.playerId == playerView.myId && (entity.entityType == RANGED_UNIT || entity.entityType == TURRET))
+                    QueryEnemies(playerView, entity, query);
+        };
+
+        focusTargets.clear();
+        BenchKernel(mapName, "QueryEnemies(attackers)", queryAttackers, first);
+        BenchKernel(mapName, "AllocateFocusFire", [&]() { AllocateFocusFire(playerView); }, first);
+        BenchKernel(mapName, "AllocateFocusFire+QueryEnemies(attackers)", [&]() { AllocateFocusFire(playerView); queryAttackers(); }, first);
+        focusTargets.clear();
+
+        if (numOfSquads)
+            BenchKernel(mapName, "MakeSquadField", [&]() { squads[0].enemies = enemyQuery_t(); MakeSquadField(playerView, squads[0]); }, first);
+    }
+}
+
+/*
+===================
+RunBenchmarks
+===================
+*/
+int RunBenchmarks(int numOfFiles, char **fileNames)
+{
+    const int resourceDensities[] = { 5, 20, 40 };
+    const int unitCounts[] = { 5, 40 };
+    vector<PlayerView> recordedViews(numOfFiles);
+    bool first = true;
+
+    for (int i = 0; i < numOfFiles; i++)
+    {
+        if (!LoadPlayerView(fileNames[i], recordedViews[i]))
+        {
+            cerr << "Can't load " << fileNames[i] << endl;
+            return 1;
+        }
+    }
+
+    printf("[");
+
+    for (int density : resourceDensities)
+    {
+        for (int units : unitCounts)
+        {
+            for (int fog = 0; fog <= 1; fog++)
+            {
+                string mapName = "synthetic-resources" + to_string(density) + "-units" + to_string(units) + (fog ? "-fog" : "");
+                BenchMap(mapName, MakeSyntheticView(density * 100 + units, density, units, fog != 0), first);
+            }
+        }
+    }
+
+    for (int i = 0; i < numOfFiles; i++)
+        BenchMap(fileNames[i], recordedViews[i], first);
+
+    printf("\n]\n");
+    return 0;
+}
+
+#ifdef ORACLE_VALIDATION
+/*
+===================
+MakeRandomView
+
+Any number of players and entities anywhere on the map, the kernels must agree with their references on all of them
+===================
+*/
+PlayerView MakeRandomView(unsigned int &random)
+{
+    auto nextRandom = [&random](int range) { random = random * 1103515245u + 12345u; return (int)((random >> 8) % (unsigned int)range); };
+    const EntityType types[] = { WALL, HOUSE, BUILDER_BASE, BUILDER_UNIT, MELEE_BASE, MELEE_UNIT, RANGED_BASE, RANGED_UNIT, TURRET };
+    unordered_map<EntityType, EntityProperties> properties = MakeDefaultProperties();
+    vector<Player> players;
+    vector<Entity> entities;
+    bool occupied[MAP_SIZE][MAP_SIZE] = {};
+    int numOfPlayers = nextRandom(2) ? 4 : 2;
+    int numOfEntities = nextRandom(600);
+    int numOfResources = nextRandom(MAP_SIZE * MAP_SIZE / 2);
+
+    for (int id = 1; id <= numOfPlayers; id++)
+        players.push_back(Player(id, 0, 1000));
+
+    for (int n = 0; n < numOfEntities + numOfResources; n++)
+    {
+        EntityType type = n < numOfEntities ? types[nextRandom(9)] : RESOURCE;
+        int size = properties.at(type).size;
+        int x = nextRandom(MAP_SIZE - size + 1);
+        int y = nextRandom(MAP_SIZE - size + 1);
+        bool free = true;
+
+        for (int i = x; i < x + size; i++)
+            for (int j = y; j < y + size; j++)
+                free = free && !occupied[i][j];
+
+        if (!free) continue;
+
+        for (int i = x; i < x + size; i++)
+            for (int j = y; j < y + size; j++)
+                occupied[i][j] = true;
+
+        shared_ptr<int> playerId = type == RESOURCE ? nullptr : shared_ptr<int>(new int(1 + nextRandom(numOfPlayers)));
+        entities.push_back(Entity((int)entities.size() + 1, playerId, type, Vec2Int(x, y), 1 + nextRandom(properties.at(type).maxHealth), true));
+    }
+
+    return PlayerView(1 + nextRandom(numOfPlayers), MAP_SIZE, nextRandom(2) != 0, properties, 1000, 1000, nextRandom(1000), players, entities);
+}
+
+/*
+===================
+RunOracle
+
+Differential test of the optimized kernels against their references on random maps
+===================
+*/
+int RunOracle(unsigned int seed, int rounds)
+{
+    const EntityType buildingTypes[] = { HOUSE, TURRET, BUILDER_BASE, RANGED_BASE };
+    const EntityType enemyTypes[] = { WALL, HOUSE, BUILDER_BASE, BUILDER_UNIT, MELEE_BASE, MELEE_UNIT, RANGED_BASE, RANGED_UNIT, TURRET };
+    unsigned int random = seed;
+    auto nextRandom = [&random](int range) { random = random * 1103515245u + 12345u; return (int)((random >> 8) % (unsigned int)range); };
+    vector<Vec2Int> positions;
+
+    for (int round = 0; round < rounds; round++)
+    {
+        PlayerView playerView = MakeRandomView(random);
+        vector<const Entity *> allies;
+        vector<const Entity *> builders;
+
+        for (int type = 0; type < NUM_ENTITY_TYPES; type++)
+            allyPositions[type].Clear();
+
+        enemies.Clear();
+
+        for (int index = 0; index < (int)playerView.entities.size(); index++)
+        {
+            const Entity &entity = playerView.entities[index];
+
+            if (!entity.playerId) continue;
+
+            if (*entity.playerId == playerView.myId)
+            {
+                allyPositions[entity.entityType].Add(entity.position, index);
+                allies.push_back(&entity);
+                if (entity.entityType == BUILDER_UNIT) builders.push_back(&entity);
+            }
+            else
+            {
+                enemies.Add(entity.position, index);
+            }
+        }
+
+        AllocateFocusFire(playerView);
+
+        for (const auto &focus : focusTargets)
+        {
+            const Entity *attacker = *find_if(allies.begin(), allies.end(), [&](const Entity *ally) { return ally->id == focus.first; });
+            OracleCheck(playerView, focus.second.target == -1 || IsAtRange(playerView, *attacker, playerView.entities[focus.second.target].position, playerView.entityProperties.at(attacker->entityType).attack->attackRange), "AllocateFocusFire");
+        }
+
+        // The map of the last tick is remembered in the fog of war
+        for (int i = 0; i < MAP_SIZE; i++)
+            for (int j = 0; j < MAP_SIZE; j++)
+                worldMap[i][j] = buildMap[i][j] = (tile_t)nextRandom(3);
+
+        for (int n = 0; n < 32; n++)
+        {
+            Vec2Int center(nextRandom(MAP_SIZE), nextRandom(MAP_SIZE));
+            distance_t metric = nextRandom(2) ? DISTANCE_SQUARED : DISTANCE_MANHATTAN;
+            int range = nextRandom(2) ? nextRandom(100) : nextRandom(2 * MAP_SIZE * MAP_SIZE);
+            positionList_t positions;
+            int reference = 0;
+
+            for (const auto &entity : playerView.entities)
+            {
+                int dx = entity.position.x - center.x;
+                int dy = entity.position.y - center.y;
+
+                positions.Add(entity.position);
+
+                if ((metric == DISTANCE_SQUARED ? dx * dx + dy * dy : abs(dx) + abs(dy)) <= range)
+                    reference++;
+            }
+
+            OracleCheck(playerView, CountInRange(center, positions, metric, range) == reference, "CountInRange");
+        }
+
+        MakeSectorPyramid(playerView);
+
+        for (int n = 0; n < 32; n++)
+        {
+            Vec2Int center(nextRandom(MAP_SIZE), nextRandom(MAP_SIZE));
+            int squaredRange = nextRandom(2) ? nextRandom(100) : nextRandom(2 * MAP_SIZE * MAP_SIZE);
+            player_t player = nextRandom(2) ? PLAYER_ALLY : PLAYER_ENEMY;
+            unsigned int types = nextRandom(1 << NUM_ENTITY_TYPES);
+            int reference = 0;
+
+            for (const auto &entity : playerView.entities)
+            {
+                int dx = entity.position.x - center.x;
+                int dy = entity.position.y - center.y;
+
+                if (entity.playerId && (*entity.playerId == playerView.myId) == (player == PLAYER_ALLY) && (types & (1u << entity.entityType)) && dx * dx + dy * dy <= squaredRange)
+                    reference++;
+            }
+
+            OracleCheck(playerView, QueryRegion(center, squaredRange, player, types) == reference, "QueryRegion");
+        }
+
+        MakeVisibilityMask(playerView);
+        MakeMap(playerView, worldMap, false, nextRandom(4) != 0);
+        MakeMap(playerView, buildMap, true);
+
+        // The territory is checked by itself, it's updated from the last round's resources and then from a few changed cells
+        for (int i = 0; i < MAP_SIZE; i++)
+            for (int j = 0; j < MAP_SIZE; j++)
+                resourceMask[i][j] = worldMap[i][j] == TILE_DESTROYABLE;
+
+        UpdateTerritory(playerView);
+
+        for (int n = 0; n < 8; n++)
+        {
+            Vec2Int cell(nextRandom(MAP_SIZE), nextRandom(MAP_SIZE));
+            resourceMask[cell.x].flip(cell.y);
+            UpdateTerritory(playerView);
+        }
+
+        for (int n = 0; n < 4; n++)
+        {
+            pathGrid_t path;
+            grid_t<int> widePath;
+            grid_t<int16_t, GRID_TILED> tiledPath;
+            int range = nextRandom(2) ? numeric_limits<int>::max() : nextRandom(100);
+
+            for (int i = 0; i < MAP_SIZE; i++)
+            {
+                for (int j = 0; j < MAP_SIZE; j++)
+                {
+                    if (!nextRandom(200))                           path(i, j) = PATH_TARGET;
+                    else if (worldMap[i][j] == TILE_EMPTY)          path(i, j) = PATH_EMPTY;
+                    else if (worldMap[i][j] == TILE_DESTROYABLE)    path(i, j) = PATH_DESTROYABLE;
+                    else                                            path(i, j) = PATH_BLOCKED;
+                }
+            }
+
+            path(nextRandom(MAP_SIZE), nextRandom(MAP_SIZE)) = PATH_START;
+            path.ForEach([&](int i, int j, int16_t &cell) { widePath(i, j) = cell; tiledPath(i, j) = cell; });
+
+            SearchPath(playerView, path, positions, range);
+            SearchPath(playerView, widePath, positions, range);
+            SearchPath(playerView, tiledPath, positions, range);
+        }
+
+        for (int n = 0; n < 8; n++)
+        {
+            const Entity *builder = builders.empty() || !nextRandom(4) ? nullptr : builders[nextRandom((int)builders.size())];
+            buildingAlign_t align = (buildingAlign_t)nextRandom(3);
+            Vec2Int position;
+
+            SearchPlaceForBuilding(playerView, builder, position, positions, buildingTypes[nextRandom(4)], nextRandom(30), align);
+        }
+
+        for (int n = 0; n < 32 && !allies.empty(); n++)
+        {
+            const Entity &entity = *allies[nextRandom((int)allies.size())];
+            enemyQuery_t query;
+            vector<EntityType> preferedTypes;
+            Vec2Int position;
+            int targetId;
+
+            for (const auto &type : enemyTypes)
+                if (!nextRandom(3))
+                    preferedTypes.push_back(type);
+
+            SearchForEnemies(playerView, entity, query, position, targetId, nextRandom(2) ? numeric_limits<int>::max() : nextRandom(40), preferedTypes);
+            IsAtRange(playerView, entity, Vec2Int(nextRandom(MAP_SIZE), nextRandom(MAP_SIZE)), nextRandom(12));
+            IsItWorthToAttack(playerView, entity, nextRandom(12), nextRandom(12));
+        }
+
+        // Half of the maps are mostly open, the tables are updated from the last round's ones
+        if (nextRandom(2))
+            for (int i = 0; i < MAP_SIZE; i++)
+                for (int j = 0; j < MAP_SIZE; j++)
+                    if (nextRandom(8))
+                        worldMap[i][j] = TILE_EMPTY;
+
+        MakeMoveMap(playerView);
+        UpdateJumpTables();
+        MakeReachLabels();
+
+        static int8_t updatedJumps[2][MAP_SIZE][MAP_SIZE];
+        memcpy(updatedJumps, xJumps, sizeof(xJumps));
+        jumpTablesValid = false;
+        UpdateJumpTables();
+        OracleCheck(playerView, !memcmp(updatedJumps, xJumps, sizeof(xJumps)), "UpdateJumpTables");
+
+        for (int n = 0; n < 16; n++)
+        {
+            vector<Vec2Int> cells;
+            Vec2Int from(nextRandom(MAP_SIZE), nextRandom(MAP_SIZE));
+            Vec2Int to(nextRandom(MAP_SIZE), nextRandom(MAP_SIZE));
+            int maxLength = nextRandom(2) ? numeric_limits<int16_t>::max() : abs(to.x - from.x) + abs(to.y - from.y) + nextRandom(16);
+
+            bool found = JumpSearch(from, to, maxLength, cells);
+            OracleCheck(playerView, !found || turretMask[from.x][from.y] || turretMask[to.x][to.y] || IsReachable(REACH_OPEN, from, 1, to), "IsReachable(open)");
+        }
+
+        // Move checks the labels against the flood itself
+        for (int n = 0; n < 16 && !allies.empty(); n++)
+        {
+            const Entity &entity = *allies[nextRandom((int)allies.size())];
+            Vec2Int to = nextRandom(4) ? Vec2Int(nextRandom(MAP_SIZE), nextRandom(MAP_SIZE)) : entity.position;
+            Vec2Int move;
+
+            unitPaths.erase(entity.id);
+            Move(playerView, entity, to, move);
+        }
+    }
+
+    printf("oracle: %d rounds, %lld checks passed\n", rounds, numOfOracleChecks.load());
+    return 0;
+}
+#endif
+
+/*
+===================
+RunReplay
+
+Restores the state before every run, so every run rebuilds the caches that the game had made incrementally
+===================
+*/
+int RunReplay(const char *fileName, int runs)
+{
+    CacheMissCounter cacheMisses;
+    MyStrategy strategy;
+    PlayerView playerView;
+    vector<char> state;
+    double tickMs;
+    double firstMs = 0.0;
+    double minMs = numeric_limits<double>::max();
+    double totalMs = 0.0;
+    long long misses = 0;
+    FILE *file = fopen(fileName, "rb");
+
+    if (!file)
+    {
+        cerr << "Can't open " << fileName << endl;
+        return 1;
+    }
+
+    try
+    {
+        FileInputStream stream(file);
+
+        if (stream.readInt() != slowTickFileVersion)
+            throw runtime_error("Unknown version");
+
+        tickMs = stream.readDouble();
+        playerView = PlayerView::readFrom(stream);
+
+        char buffer[4096];
+        size_t size;
+
+        while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            state.insert(state.end(), buffer, buffer + size);
+    }
+    catch (const exception &error)
+    {
+        cerr << "Can't read " << fileName << ": " << error.what() << endl;
+        fclose(file);
+        return 1;
+    }
+
+    fclose(file);
+
+    for (int run = 0; run < runs; run++)
+    {
+        MemoryInputStream stream(state);
+        ReadTickState(stream);
+
+        auto start = chrono::steady_clock::now();
+        cacheMisses.Start();
+        strategy.getAction(playerView, nullptr);
+        misses += cacheMisses.Stop();
+        double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        if (!run) firstMs = elapsed;
+        minMs = min(minMs, elapsed);
+        totalMs += elapsed;
+    }
+
+    printf("{ \"file\": %s, \"tick\": %d, \"recordedMs\": %.3f, \"runs\": %d, \"firstMs\": %.3f, \"minMs\": %.3f, \"avgMs\": %.3f, ", JsonString(fileName).c_str(), playerView.currentTick, tickMs, runs, firstMs, minMs, totalMs / runs);
+
+    if (cacheMisses.Available())
+        printf("\"cacheMissesPerRun\": %.1f }\n", (double)misses / runs);
+    else
+        printf("\"cacheMissesPerRun\": null }\n");
+
+    return 0;
+}
+
+/*
+===================
+RunSummarize
+
+Every column is summed up, the means of the later files are compared with the first file in percents
+===================
+*/
+int RunSummarize(int numOfFiles, char **fileNames)
+{
+    vector<string> columns;
+    vector<double> firstMeans;
+
+    for (int i = 0; i < numOfFiles; i++)
+    {
+        vector<string> header;
+        vector<double> totals;
+        vector<double> maximums;
+        char line[1024];
+        int ticks = 0;
+        FILE *file = fopen(fileNames[i], "r");
+
+        if (!file)
+        {
+            cerr << "Can't open " << fileNames[i] << endl;
+            return 1;
+        }
+
+        if (fgets(line, sizeof(line), file))
+        {
+            for (char *token = strtok(line, ",\r\n"); token; token = strtok(nullptr, ",\r\n"))
+                header.push_back(token);
+        }
+
+        if (header.empty() || (i && header != columns))
+        {
+            cerr << "Unknown columns in " << fileNames[i] << endl;
+            fclose(file);
+            return 1;
+        }
+
+        columns = header;
+        totals.assign(columns.size(), 0.0);
+        maximums.assign(columns.size(), numeric_limits<double>::lowest());
+
+        while (fgets(line, sizeof(line), file))
+        {
+            char *token = strtok(line, ",\r\n");
+
+            if (!token)
+                continue;
+
+            for (int j = 0; j < (int)columns.size() && token; j++, token = strtok(nullptr, ",\r\n"))
+            {
+                double value = strtod(token, nullptr);
+                totals[j] += value;
+                maximums[j] = max(maximums[j], value);
+            }
+
+            ticks++;
+        }
+
+        fclose(file);
+
+        if (!ticks)
+        {
+            cerr << "No ticks in " << fileNames[i] << endl;
+            return 1;
+        }
+
+        printf("{ \"file\": %s, \"ticks\": %d", JsonString(fileNames[i]).c_str(), ticks);
+
+        // The tick column isn't worth summing up
+        for (int j = 1; j < (int)columns.size(); j++)
+        {
+            double mean = totals[j] / ticks;
+            printf(", %s: { \"mean\": %.3f, \"max\": %.3f, \"total\": %.3f", JsonString(columns[j]).c_str(), mean, maximums[j], totals[j]);
+
+            if (!i)
+                firstMeans.push_back(mean);
+            else if (firstMeans[j - 1] != 0.0)
+                printf(", \"change\": %.1f", (mean / firstMeans[j - 1] - 1.0) * 100.0);
+            else
+                printf(", \"change\": null");
+
+            printf(" }");
+        }
+
+        printf(" }\n");
+    }
+
+    return 0;
+}
+
+/*
+===================
+main
+===================
+*/
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && string(argv[1]) == "bench")
+        return RunBenchmarks(argc - 2, argv + 2);
+
+    if (argc >= 2 && string(argv[1]) == "oracle")
+    {
+#ifdef ORACLE_VALIDATION
+        return RunOracle(argc >= 3 ? (unsigned int)stoul(argv[2]) : 1, argc >= 4 ? stoi(argv[3]) : 200);
+#else
+        cerr << "Build with -DORACLE_VALIDATION to run the oracle" << endl;
+        return 1;
+#endif
+    }
+
+    if (argc >= 3 && string(argv[1]) == "replay")
+        return RunReplay(argv[2], argc >= 4 ? max(stoi(argv[3]), 1) : 1);
+
+    if (argc >= 3 && string(argv[1]) == "summarize")
+        return RunSummarize(argc - 2, argv + 2);
+
+    cerr << "Usage: " << argv[0] << " bench [view files...] | oracle [seed] [rounds] | replay file [runs] | summarize files..." << endl;
+    return 1;
+}